@@ -0,0 +1,73 @@
+// modify buffer size to 64-bytes
+// must be called before include.
+#define USC_BUFSIZE 64
+#include <USCommand.h>
+#include <USCDispatch.h>
+
+#define DEVICE_ADDR 11
+#define COMP_SYSTEM 0
+#define COMP_MOTOR 1
+
+usc::Command cmd(DEVICE_ADDR);
+
+void onVersion(usc::Command &c, usc::Params &pars) {
+  if (!c.isBroadcast()) {
+    Serial.println(F("Dispatch sample v1.0.0"));
+  }
+}
+
+void onHome(usc::Command &c, usc::Params &pars) {
+  Serial.println(F("Move to HOME"));
+}
+
+void onMove(usc::Command &c, usc::Params &pars) {
+  int step = pars.find("step").valueInt();
+
+  // routes can share a handler, the action hash is known at compile time
+  switch (c.actionHash()) {
+    case usc::hash("forward"):
+      Serial.print(F("Forward movement: "));
+      break;
+    case usc::hash("reverse"):
+      Serial.print(F("Reverse movement: "));
+      break;
+  }
+  Serial.print(step);
+  Serial.println(F(" step(s)"));
+}
+
+const usc::Route routes[] = {
+  {COMP_SYSTEM, "", onVersion, nullptr},
+  {COMP_SYSTEM, "version", onVersion, nullptr},
+  {COMP_MOTOR, "home", onHome, nullptr},
+  {COMP_MOTOR, "forward", onMove, nullptr},
+  {COMP_MOTOR, "reverse", onMove, nullptr},
+};
+usc::DispatchTable<5> dispatcher(routes);
+
+// called for commands without a registered route
+void onCommand(bool broadcast, uint16_t component, const char *action, usc::Params &pars) {
+  if (!broadcast) {
+    Serial.print(F("Unknown action:"));
+    Serial.println(action);
+  }
+}
+
+void setup() {
+  Serial.begin(9600);
+  if (!dispatcher.build()) {
+    Serial.println(F("Duplicated route"));
+  }
+  cmd.attachDispatcher(&dispatcher);
+  cmd.attachCallback(onCommand);
+}
+
+void loop() {
+  if (Serial.available()) {
+    int ch = Serial.read();
+    while (ch != -1) {
+      cmd.process((char)ch);
+      ch = Serial.read();
+    }
+  }
+}
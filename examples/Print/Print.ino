@@ -2,8 +2,11 @@
 // must be called before include.
 #define USC_BUFSIZE 64
 #include <USCommand.h>
+#include <USCWriter.h>
 
 usc::Command cmd;
+char out[USC_BUFSIZE];
+usc::ResponseWriter resp(out, sizeof(out));
 
 void setup() {
   Serial.begin(9600);
@@ -38,9 +41,11 @@ void printCommand() {
   }
   
   Serial.println("Response:");
-  Serial.println(cmd.beginResponse());
-  Serial.print(F("<<\nANY DATA\n"));
-  Serial.print(cmd.endResponse());
+  resp.clear();
+  resp.begin().device((uint8_t)cmd.device()).component(cmd.component());
+  resp.param("pars", (long)cmd.params().count());
+  resp.end();
+  Serial.println(resp.data());
 }
 
 void loop() {
@@ -0,0 +1,330 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include "USCCapture.h"
+
+static const char Magic[8] = {'U', 'S', 'C', 'C', 'A', 'P', '1', '\n'};
+static const size_t HeaderSize = 16;
+
+namespace usc
+{
+    CaptureWriter::CaptureWriter()
+        : _fd(-1), _started(false), _failed(false), _last(0), _records(0), _bytes(0), _n(0), _buf(nullptr)
+    {
+    }
+    CaptureWriter::~CaptureWriter()
+    {
+        close();
+    }
+
+    uint64_t CaptureWriter::clock(void)
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    bool CaptureWriter::isOpen(void) const
+    {
+        return _fd >= 0;
+    }
+    uint64_t CaptureWriter::records(void) const
+    {
+        return _records;
+    }
+    uint64_t CaptureWriter::bytes(void) const
+    {
+        return _bytes;
+    }
+
+    bool CaptureWriter::open(const char *path)
+    {
+        close();
+        _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (_fd < 0)
+        {
+            return false;
+        }
+        _buf = new char[USC_CAPTURE_BUFSIZE];
+        _started = false;
+        _failed = false;
+        _records = 0;
+        _bytes = 0;
+
+        uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+        char header[HeaderSize];
+        memcpy(header, Magic, sizeof(Magic));
+        for (int i = 0; i < 8; i++)
+        {
+            header[8 + i] = (char)(now >> (8 * i));
+        }
+        return put(header, sizeof(header));
+    }
+
+    bool CaptureWriter::write(uint8_t port, const char *buf, size_t n, uint64_t us)
+    {
+        if (_fd < 0 || _failed)
+        {
+            return false;
+        }
+        // the first record starts the time line, a clock going back counts as no delay
+        uint64_t delta = _started && us > _last ? us - _last : 0;
+        if (!_started || us > _last)
+        {
+            _last = us;
+        }
+        _started = true;
+
+        char head[21];
+        size_t k = 0;
+        do
+        {
+            head[k++] = (char)((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0));
+            delta >>= 7;
+        } while (delta != 0);
+        head[k++] = (char)port;
+        uint64_t len = n;
+        do
+        {
+            head[k++] = (char)((len & 0x7F) | (len > 0x7F ? 0x80 : 0));
+            len >>= 7;
+        } while (len != 0);
+
+        if (!put(head, k) || !put(buf, n))
+        {
+            return false;
+        }
+        _records++;
+        _bytes += n;
+        return true;
+    }
+
+    bool CaptureWriter::put(const void *p, size_t n)
+    {
+        if (_n + n > USC_CAPTURE_BUFSIZE && !flush())
+        {
+            return false;
+        }
+        if (n < USC_CAPTURE_BUFSIZE)
+        {
+            memcpy(_buf + _n, p, n);
+            _n += n;
+            return true;
+        }
+
+        // chunks larger than the buffer go straight to the file
+        const char *b = (const char *)p;
+        while (n > 0)
+        {
+            ssize_t w = ::write(_fd, b, n);
+            if (w < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (w <= 0)
+            {
+                _failed = true;
+                return false;
+            }
+            b += w;
+            n -= w;
+        }
+        return true;
+    }
+
+    bool CaptureWriter::flush(void)
+    {
+        if (_fd < 0 || _failed)
+        {
+            return false;
+        }
+        size_t done = 0;
+        while (done < _n)
+        {
+            ssize_t w = ::write(_fd, _buf + done, _n - done);
+            if (w < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (w <= 0)
+            {
+                _failed = true;
+                return false;
+            }
+            done += w;
+        }
+        _n = 0;
+        return true;
+    }
+
+    bool CaptureWriter::close(void)
+    {
+        if (_fd < 0)
+        {
+            return true;
+        }
+        bool ok = flush();
+        ok = ::close(_fd) == 0 && ok;
+        _fd = -1;
+        _n = 0;
+        delete[] _buf;
+        _buf = nullptr;
+        return ok;
+    }
+
+    CaptureReader::CaptureReader()
+        : _map(nullptr), _size(0), _pos(0), _released(0), _time(0), _started(0), _truncated(false)
+    {
+    }
+    CaptureReader::~CaptureReader()
+    {
+        close();
+    }
+
+    bool CaptureReader::open(const char *path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < HeaderSize)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            return false;
+        }
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        _map = (const char *)p;
+        _size = st.st_size;
+        if (memcmp(_map, Magic, sizeof(Magic)) != 0)
+        {
+            close();
+            return false;
+        }
+        _started = 0;
+        for (int i = 7; i >= 0; i--)
+        {
+            _started = (_started << 8) | (uint8_t)_map[8 + i];
+        }
+        rewind();
+        return true;
+    }
+
+    void CaptureReader::close(void)
+    {
+        if (_map)
+        {
+            munmap((void *)_map, _size);
+        }
+        _map = nullptr;
+        _size = 0;
+        _pos = 0;
+        _released = 0;
+        _time = 0;
+        _truncated = false;
+    }
+
+    void CaptureReader::rewind(void)
+    {
+        _pos = _map ? HeaderSize : 0;
+        _released = 0;
+        _time = 0;
+        _truncated = false;
+    }
+
+    bool CaptureReader::isOpen(void) const
+    {
+        return _map != nullptr;
+    }
+    // true when the file ends inside a record, e.g. the recorder was killed
+    bool CaptureReader::isTruncated(void) const
+    {
+        return _truncated;
+    }
+    uint64_t CaptureReader::started(void) const
+    {
+        return _started;
+    }
+    size_t CaptureReader::size(void) const
+    {
+        return _size;
+    }
+    size_t CaptureReader::offset(void) const
+    {
+        return _pos;
+    }
+
+    bool CaptureReader::varint(uint64_t &v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64 && _pos < _size; shift += 7)
+        {
+            uint8_t b = (uint8_t)_map[_pos++];
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // time is in microseconds since the first record
+    bool CaptureReader::next(CaptureRecord &rec)
+    {
+        if (_pos >= _size)
+        {
+            return false;
+        }
+        uint64_t delta, len = 0;
+        bool ok = varint(delta) && _pos < _size;
+        if (ok)
+        {
+            rec.port = (uint8_t)_map[_pos++];
+            ok = varint(len) && len <= _size - _pos;
+        }
+        if (!ok)
+        {
+            _truncated = true;
+            _pos = _size;
+            return false;
+        }
+        _time += delta;
+        rec.time = _time;
+        rec.data = _map + _pos;
+        rec.length = len;
+        _pos += len;
+
+        if (_pos - _released >= USC_CAPTURE_RELEASE)
+        {
+            release();
+        }
+        return true;
+    }
+
+    // the pages are only dropped from memory, touching them again reads them back
+    void CaptureReader::release(void)
+    {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t end = _pos / page * page;
+        if (end > _released)
+        {
+            madvise((void *)(_map + _released), end - _released, MADV_DONTNEED);
+            _released = end;
+        }
+    }
+};
@@ -0,0 +1,106 @@
+#ifndef _USCCAPTURE_H_
+#define _USCCAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bytes collected by CaptureWriter before they are written to the file
+#ifndef USC_CAPTURE_BUFSIZE
+#define USC_CAPTURE_BUFSIZE 65536
+#endif
+
+// bytes CaptureReader reads past before it drops them from memory again
+#ifndef USC_CAPTURE_RELEASE
+#define USC_CAPTURE_RELEASE (64UL << 20)
+#endif
+
+namespace usc
+{
+    // Capture file: a header of the magic "USCCAP1\n" and the wall clock time it was
+    // opened (microseconds since 1970, 8 bytes little endian), followed by one
+    // record per chunk read from a port:
+    //   delta   microseconds since the previous record, varint
+    //   port    one byte
+    //   length  varint
+    //   bytes
+    // varints hold 7 bits per byte, least significant first, the high bit set on all
+    // but the last byte.
+    struct CaptureRecord
+    {
+        uint64_t time;
+        uint8_t port;
+        const char *data;
+        size_t length;
+    };
+
+    // Appends records to a capture file, buffered, flushed by flush() and close().
+    class CaptureWriter
+    {
+    public:
+        CaptureWriter();
+        ~CaptureWriter();
+
+        bool open(const char *path);
+        bool write(uint8_t port, const char *buf, size_t n, uint64_t us = clock());
+        bool flush(void);
+        bool close(void);
+        bool isOpen(void) const;
+        uint64_t records(void) const;
+        uint64_t bytes(void) const;
+
+        // microseconds of a monotonic clock
+        static uint64_t clock(void);
+
+    private:
+        int _fd;
+        bool _started;
+        bool _failed;
+        uint64_t _last;
+        uint64_t _records;
+        uint64_t _bytes;
+        size_t _n;
+        char *_buf;
+
+        CaptureWriter(const CaptureWriter &);
+        CaptureWriter &operator=(const CaptureWriter &);
+
+        bool put(const void *p, size_t n);
+    };
+
+    // Reads a capture file through a read only mapping, records point into the mapping
+    // and stay valid until close(). Pages already read are dropped every
+    // USC_CAPTURE_RELEASE bytes, so captures larger than memory stream through.
+    class CaptureReader
+    {
+    public:
+        CaptureReader();
+        ~CaptureReader();
+
+        bool open(const char *path);
+        void close(void);
+        bool next(CaptureRecord &rec);
+        void rewind(void);
+        bool isOpen(void) const;
+        bool isTruncated(void) const;
+        uint64_t started(void) const;
+        size_t size(void) const;
+        size_t offset(void) const;
+
+    private:
+        const char *_map;
+        size_t _size;
+        size_t _pos;
+        size_t _released;
+        uint64_t _time;
+        uint64_t _started;
+        bool _truncated;
+
+        CaptureReader(const CaptureReader &);
+        CaptureReader &operator=(const CaptureReader &);
+
+        bool varint(uint64_t &v);
+        void release(void);
+    };
+};
+
+#endif
@@ -0,0 +1,323 @@
+#include <string.h>
+#include <chrono>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "USCEngine.h"
+
+// Packet::_flags bits
+enum
+{
+    fResponse = 0x01,
+    fChecksum = 0x02,
+    fId = 0x04
+};
+
+// idle rounds of a worker before it starts sleeping
+#define USC_SPIN_ROUNDS 256
+
+namespace usc
+{
+    Packet::Packet()
+        : _device(InvalidDevice), _hash(USC_HASH_BASIS), _component(0), _id(0), _stream(0),
+          _flags(0), _checksum(0), _action(0), _len(0)
+    {
+        _data[0] = 0;
+    }
+    Packet::Packet(const Packet &pkt)
+    {
+        *this = pkt;
+    }
+    Packet &Packet::operator=(const Packet &pkt)
+    {
+        // only the used part of the buffer and the index
+        _device = pkt._device;
+        _hash = pkt._hash;
+        _component = pkt._component;
+        _id = pkt._id;
+        _stream = pkt._stream;
+        _flags = pkt._flags;
+        _checksum = pkt._checksum;
+        _action = pkt._action;
+        _len = pkt._len;
+        memcpy(_data, pkt._data, _len + 1);
+        memcpy(_params._index, pkt._params._index, pkt._params._count * sizeof(ParamEntry));
+        _params._count = pkt._params._count;
+        _params._data = _data;
+        _params.begin();
+        return *this;
+    }
+
+    void Packet::assign(uint8_t stream, const Command &cmd)
+    {
+        _device = cmd._device;
+        _hash = cmd._hash;
+        _component = cmd._component;
+        _id = cmd._id;
+        _stream = stream;
+        _flags = (cmd.isResponse() ? fResponse : 0) | (cmd._hasChecksum ? fChecksum : 0) |
+                 (cmd._hasId ? fId : 0);
+        _checksum = cmd._checksum;
+        _action = cmd._action ? cmd._action - cmd._data : 0;
+        _len = cmd._np;
+        memcpy(_data, cmd._data, _len + 1);
+        memcpy(_params._index, cmd._params._index, cmd._params._count * sizeof(ParamEntry));
+        _params._count = cmd._params._count;
+        _params._data = _data;
+        _params.begin();
+    }
+
+    uint8_t Packet::stream(void) const
+    {
+        return _stream;
+    }
+    bool Packet::isBroadcast(void) const
+    {
+        return _device == USC_BROADCAST_ADDR;
+    }
+    bool Packet::isResponse(void) const
+    {
+        return (_flags & fResponse) != 0;
+    }
+    bool Packet::hasChecksum(void) const
+    {
+        return (_flags & fChecksum) != 0;
+    }
+    check::Value Packet::checksum(void) const
+    {
+        return _checksum;
+    }
+    uint32_t Packet::device(void) const
+    {
+        return _device;
+    }
+    uint16_t Packet::component(void) const
+    {
+        return _component;
+    }
+    bool Packet::hasId(void) const
+    {
+        return (_flags & fId) != 0;
+    }
+    uint16_t Packet::id(void) const
+    {
+        return _id;
+    }
+    bool Packet::hasAction(void) const
+    {
+        return _action != 0 && _data[_action] != 0;
+    }
+    const char *Packet::action(void) const
+    {
+        return _action ? _data + _action : "";
+    }
+    uint32_t Packet::actionHash(void) const
+    {
+        return _hash;
+    }
+    const char *Packet::data(void) const
+    {
+        return _data;
+    }
+    int Packet::length(void) const
+    {
+        return _len;
+    }
+    Params &Packet::params(void)
+    {
+        _params.begin();
+        return _params;
+    }
+
+    Engine::Engine(PacketCb fnPacket, unsigned workers, bool pin, bool steal)
+        : packetCb(fnPacket), _pin(pin), _steal(steal), _running(false)
+    {
+        _count = workers ? workers : std::thread::hardware_concurrency();
+        if (_count == 0)
+        {
+            _count = 1;
+        }
+        _workers = new Worker[_count];
+        for (unsigned w = 0; w < _count; w++)
+        {
+            _workers[w].handled = 0;
+            _workers[w].stolen = 0;
+        }
+    }
+    Engine::~Engine()
+    {
+        stop();
+        delete[] _workers;
+    }
+
+    unsigned Engine::workers(void) const
+    {
+        return _count;
+    }
+    uint64_t Engine::handled(void) const
+    {
+        uint64_t n = 0;
+        for (unsigned w = 0; w < _count; w++)
+        {
+            n += _workers[w].handled.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+    uint64_t Engine::stolen(void) const
+    {
+        uint64_t n = 0;
+        for (unsigned w = 0; w < _count; w++)
+        {
+            n += _workers[w].stolen.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    bool Engine::start(void)
+    {
+        if (_running.exchange(true))
+        {
+            return false;
+        }
+        // the core count may be unknown (0), the workers are not pinned then
+        unsigned cores = std::thread::hardware_concurrency();
+        for (unsigned w = 0; w < _count; w++)
+        {
+            _workers[w].thread = std::thread(&Engine::run, this, w);
+#if defined(__linux__)
+            if (_pin && cores > 0)
+            {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                CPU_SET(w % cores, &cpus);
+                pthread_setaffinity_np(_workers[w].thread.native_handle(), sizeof(cpus), &cpus);
+            }
+#endif
+        }
+        return true;
+    }
+
+    // Workers empty their queues before they exit.
+    void Engine::stop(void)
+    {
+        if (!_running.exchange(false))
+        {
+            return;
+        }
+        for (unsigned w = 0; w < _count; w++)
+        {
+            if (_workers[w].thread.joinable())
+            {
+                _workers[w].thread.join();
+            }
+        }
+    }
+
+    bool Engine::post(const Packet &pkt)
+    {
+        return _workers[pkt.stream() % _count].queue.push(pkt);
+    }
+
+    bool Engine::take(unsigned w, Packet &pkt)
+    {
+        if (_workers[w].queue.pop(pkt))
+        {
+            return true;
+        }
+        if (!_steal)
+        {
+            return false;
+        }
+        for (unsigned i = 1; i < _count; i++)
+        {
+            unsigned v = (w + i) % _count;
+            if (_workers[v].queue.pop(pkt))
+            {
+                _workers[w].stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Engine::run(unsigned w)
+    {
+        Worker &self = _workers[w];
+        Packet pkt;
+        unsigned idle = 0;
+        for (;;)
+        {
+            if (take(w, pkt))
+            {
+                idle = 0;
+                if (packetCb)
+                {
+                    packetCb(pkt);
+                }
+                self.handled.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (!_running.load(std::memory_order_acquire))
+            {
+                // a packet may have been posted between take() and the check
+                if (self.queue.empty())
+                {
+                    break;
+                }
+                continue;
+            }
+            if (++idle < USC_SPIN_ROUNDS)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    Feeder::Feeder(Engine &engine, CommandPool &pool)
+        : _engine(engine), _pool(pool), _errors(0), _dropped(0)
+    {
+    }
+
+    uint64_t Feeder::errors(void) const
+    {
+        return _errors;
+    }
+    uint64_t Feeder::dropped(void) const
+    {
+        return _dropped;
+    }
+
+    int Feeder::process(uint8_t stream, const char *buf, size_t n)
+    {
+        int nf = 0;
+        while (n > 0)
+        {
+            Result res;
+            size_t used = _pool.process(stream, buf, n, res);
+            buf += used;
+            n -= used;
+            if (res == OK)
+            {
+                _pkt.assign(stream, _pool.command());
+                if (_engine.post(_pkt))
+                {
+                    nf++;
+                }
+                else
+                {
+                    _dropped++;
+                }
+            }
+            else if (res != Next)
+            {
+                _errors++;
+            }
+        }
+        return nf;
+    }
+};
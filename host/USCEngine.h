@@ -0,0 +1,124 @@
+#ifndef _USCENGINE_H_
+#define _USCENGINE_H_
+
+#include <atomic>
+#include <thread>
+#include "../src/USCommand.h"
+#include "../src/USCPool.h"
+#include "USCRing.h"
+
+#ifndef USC_QUEUE_SIZE
+#define USC_QUEUE_SIZE 1024
+#endif
+
+namespace usc
+{
+    // Completed frame moved from the parsing thread to a worker: the used part of
+    // the command buffer and the offsets found by the parser.
+    class Packet
+    {
+    public:
+        Packet();
+        Packet(const Packet &pkt);
+        Packet &operator=(const Packet &pkt);
+
+        void assign(uint8_t stream, const Command &cmd);
+
+        uint8_t stream(void) const;
+        bool isBroadcast(void) const;
+        bool isResponse(void) const;
+        bool hasChecksum(void) const;
+        check::Value checksum(void) const;
+        uint32_t device(void) const;
+        uint16_t component(void) const;
+        bool hasId(void) const;
+        uint16_t id(void) const;
+        bool hasAction(void) const;
+        const char *action(void) const;
+        uint32_t actionHash(void) const;
+        const char *data(void) const;
+        int length(void) const;
+        Params &params(void);
+
+    private:
+        uint32_t _device;
+        uint32_t _hash;
+        uint16_t _component;
+        uint16_t _id;
+        uint8_t _stream;
+        uint8_t _flags;
+        check::Value _checksum;
+        Offset _action;
+        Offset _len;
+        Params _params;
+        char _data[USC_BUFSIZE + 1];
+    };
+
+    // callback type, called on a worker thread
+    typedef void (*PacketCb)(Packet &pkt);
+
+    // Worker threads, one per core, each with its own queue. Packets of a stream go to
+    // the queue of worker `stream % workers`, so frames of a stream are handled in order
+    // unless an idle worker steals them from a busy one. post() does not wait, it returns
+    // false when the queue of the stream is full.
+    class Engine
+    {
+    public:
+        typedef MpmcRing<Packet, USC_QUEUE_SIZE> Queue;
+
+        Engine(PacketCb fnPacket, unsigned workers = 0, bool pin = true, bool steal = true);
+        ~Engine();
+
+        bool start(void);
+        void stop(void);
+        bool post(const Packet &pkt);
+        unsigned workers(void) const;
+        uint64_t handled(void) const;
+        uint64_t stolen(void) const;
+
+    private:
+        struct Worker
+        {
+            Queue queue;
+            std::thread thread;
+            std::atomic<uint64_t> handled;
+            std::atomic<uint64_t> stolen;
+        };
+
+        PacketCb packetCb;
+        unsigned _count;
+        bool _pin;
+        bool _steal;
+        std::atomic<bool> _running;
+        Worker *_workers;
+
+        Engine(const Engine &);
+        Engine &operator=(const Engine &);
+
+        void run(unsigned w);
+        bool take(unsigned w, Packet &pkt);
+    };
+
+    // Parses the chunks read by one I/O thread and posts the completed frames to the
+    // engine, the callbacks never run on this thread. A frame whose queue is full is
+    // dropped and only counted in dropped(), there is no back-pressure on the reader;
+    // size the queues (USC_QUEUE_SIZE) for the longest burst the workers fall behind.
+    class Feeder
+    {
+    public:
+        Feeder(Engine &engine, CommandPool &pool);
+
+        int process(uint8_t stream, const char *buf, size_t n);
+        uint64_t errors(void) const;
+        uint64_t dropped(void) const;
+
+    private:
+        Engine &_engine;
+        CommandPool &_pool;
+        Packet _pkt;
+        uint64_t _errors;
+        uint64_t _dropped;
+    };
+};
+
+#endif
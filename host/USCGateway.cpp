@@ -0,0 +1,628 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "USCGateway.h"
+#include "USCCapture.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define USC_HAVE_URING
+#endif
+#endif
+#endif
+
+// user_data of the timeout request
+#define USC_TIMEOUT_TAG UINT64_MAX
+
+namespace usc
+{
+#if defined(USC_HAVE_URING)
+    // io_uring driven with raw system calls, no liburing needed
+    struct Gateway::Ring
+    {
+        int fd;
+        bool fixed;
+        unsigned *sqHead;
+        unsigned *sqTail;
+        unsigned *sqMask;
+        unsigned *sqArray;
+        unsigned *cqHead;
+        unsigned *cqTail;
+        unsigned *cqMask;
+        struct io_uring_sqe *sqes;
+        struct io_uring_cqe *cqes;
+        void *sqPtr;
+        void *cqPtr;
+        size_t sqLen;
+        size_t cqLen;
+        size_t sqesLen;
+        unsigned pending;
+        struct __kernel_timespec ts;
+
+        Ring()
+            : fd(-1), fixed(false), sqes((struct io_uring_sqe *)MAP_FAILED), sqPtr(MAP_FAILED),
+              cqPtr(MAP_FAILED), pending(0)
+        {
+        }
+        ~Ring()
+        {
+            if (sqes != MAP_FAILED)
+            {
+                munmap(sqes, sqesLen);
+            }
+            if (cqPtr != MAP_FAILED && cqPtr != sqPtr)
+            {
+                munmap(cqPtr, cqLen);
+            }
+            if (sqPtr != MAP_FAILED)
+            {
+                munmap(sqPtr, sqLen);
+            }
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+
+        bool setup(unsigned entries)
+        {
+            struct io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            fd = syscall(__NR_io_uring_setup, entries, &p);
+            if (fd < 0 || !(p.features & IORING_FEAT_RW_CUR_POS))
+            {
+                return false;
+            }
+
+            sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+            if (p.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                sqLen = cqLen = sqLen > cqLen ? sqLen : cqLen;
+            }
+            sqPtr = mmap(0, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sqPtr == MAP_FAILED)
+            {
+                return false;
+            }
+            if (p.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                cqPtr = sqPtr;
+            }
+            else
+            {
+                cqPtr = mmap(0, cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                if (cqPtr == MAP_FAILED)
+                {
+                    return false;
+                }
+            }
+            sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+            sqes = (struct io_uring_sqe *)mmap(0, sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                               fd, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+            {
+                return false;
+            }
+
+            char *sq = (char *)sqPtr;
+            char *cq = (char *)cqPtr;
+            sqHead = (unsigned *)(sq + p.sq_off.head);
+            sqTail = (unsigned *)(sq + p.sq_off.tail);
+            sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+            sqArray = (unsigned *)(sq + p.sq_off.array);
+            cqHead = (unsigned *)(cq + p.cq_off.head);
+            cqTail = (unsigned *)(cq + p.cq_off.tail);
+            cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+            cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+            return true;
+        }
+
+        bool registerBuffer(void *buf, size_t n)
+        {
+            struct iovec iov;
+            iov.iov_base = buf;
+            iov.iov_len = n;
+            fixed = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+            return fixed;
+        }
+
+        struct io_uring_sqe *next(void)
+        {
+            unsigned tail = *sqTail;
+            if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > *sqMask)
+            {
+                return nullptr;
+            }
+            unsigned idx = tail & *sqMask;
+            struct io_uring_sqe *sqe = &sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[idx] = idx;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            pending++;
+            return sqe;
+        }
+
+        int enter(unsigned wait)
+        {
+            int n = syscall(__NR_io_uring_enter, fd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+            if (n >= 0)
+            {
+                pending -= n;
+            }
+            return n;
+        }
+    };
+#else
+    struct Gateway::Ring
+    {
+    };
+#endif
+
+    Gateway::Gateway(int maxPorts, Backend backend)
+        : _backend(Epoll), _max(maxPorts), _count(0), _epoll(-1), _ring(nullptr), _capture(nullptr),
+          frameCb(nullptr), errCb(nullptr)
+    {
+        _ports = new Port[_max];
+        _in = new char[(size_t)_max * USC_GATEWAY_READSIZE];
+
+#if defined(USC_HAVE_URING)
+        if (backend != Epoll)
+        {
+            _ring = new Ring();
+            // a read per port plus the timeout
+            if (_ring->setup(_max + 1))
+            {
+                _ring->registerBuffer(_in, (size_t)_max * USC_GATEWAY_READSIZE);
+                _backend = IoUring;
+                return;
+            }
+            delete _ring;
+            _ring = nullptr;
+        }
+#else
+        (void)backend;
+#endif
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    Gateway::~Gateway()
+    {
+        for (int i = 0; i < _count; i++)
+        {
+            close(i);
+        }
+        delete _ring;
+        if (_epoll >= 0)
+        {
+            ::close(_epoll);
+        }
+        delete[] _in;
+        delete[] _ports;
+    }
+
+    Gateway::Backend Gateway::backend(void) const
+    {
+        return _backend;
+    }
+    int Gateway::ports(void) const
+    {
+        return _count;
+    }
+    bool Gateway::isOpen(int port) const
+    {
+        return port >= 0 && port < _count && _ports[port].open;
+    }
+    Command &Gateway::command(int port)
+    {
+        return _ports[port].cmd;
+    }
+#if USC_STATS
+    // counters of all ports, read by the thread calling poll()
+    void Gateway::snapshot(Stats &total) const
+    {
+        memset(&total, 0, sizeof(total));
+        for (int i = 0; i < _count; i++)
+        {
+            addStats(total, _ports[i].cmd.stats());
+        }
+    }
+#endif
+    char *Gateway::input(int port)
+    {
+        return _in + (size_t)port * USC_GATEWAY_READSIZE;
+    }
+    void Gateway::attachCallback(PortCb fnFrame, PortErrorCb fnErr)
+    {
+        frameCb = fnFrame;
+        errCb = fnErr;
+    }
+    // every chunk read from a port is recorded before it is parsed, nullptr stops it
+    void Gateway::attachCapture(CaptureWriter *cap)
+    {
+        _capture = cap;
+    }
+
+    int Gateway::add(int fd, uint32_t addr)
+    {
+        if (fd < 0 || _count >= _max)
+        {
+            return -1;
+        }
+        int port = _count;
+        Port &p = _ports[port];
+        p.fd = fd;
+        p.open = true;
+        p.pollable = true;
+        p.owned = false;
+        p.cmd.changeDeviceAddress(addr);
+        p.cmd.clear();
+        p.nout = 0;
+        p.niov = 0;
+
+        if (_backend == IoUring)
+        {
+            if (!submitRead(port))
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.u32 = port;
+            if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+            {
+                // regular files are always readable and can not be watched
+                if (errno != EPERM)
+                {
+                    return -1;
+                }
+                p.pollable = false;
+            }
+        }
+        _count++;
+        return port;
+    }
+
+    int Gateway::open(const char *path, uint32_t addr)
+    {
+        int fd = ::open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return -1;
+            }
+        }
+
+        // raw mode: no echo, no line editing, every byte as it arrives
+        struct termios tio;
+        if (tcgetattr(fd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tio.c_cc[VMIN] = 1;
+            tio.c_cc[VTIME] = 0;
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+
+        int port = add(fd, addr);
+        if (port < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        _ports[port].owned = true;
+        return port;
+    }
+
+    void Gateway::close(int port)
+    {
+        Port &p = _ports[port];
+        if (!p.open)
+        {
+            return;
+        }
+        p.open = false;
+        if (_epoll >= 0 && p.pollable)
+        {
+            epoll_ctl(_epoll, EPOLL_CTL_DEL, p.fd, NULL);
+        }
+        if (p.owned)
+        {
+            ::close(p.fd);
+        }
+    }
+
+    bool Gateway::reply(int port, const char *data, size_t n, bool copy)
+    {
+        if (!isOpen(port))
+        {
+            return false;
+        }
+        Port &p = _ports[port];
+        if ((copy && p.nout + n > USC_GATEWAY_OUTSIZE) || p.niov >= USC_GATEWAY_IOV)
+        {
+            if (!flush(port) || (copy && n > USC_GATEWAY_OUTSIZE))
+            {
+                return false;
+            }
+        }
+
+        char *base = (char *)data;
+        if (copy)
+        {
+            base = p.out + p.nout;
+            memcpy(base, data, n);
+            p.nout += n;
+
+            // extend the last segment when the copy follows it
+            if (p.niov > 0)
+            {
+                struct iovec &last = p.iov[p.niov - 1];
+                if ((char *)last.iov_base + last.iov_len == base)
+                {
+                    last.iov_len += n;
+                    return true;
+                }
+            }
+        }
+        p.iov[p.niov].iov_base = base;
+        p.iov[p.niov].iov_len = n;
+        p.niov++;
+        return true;
+    }
+
+    // the frame is queued whole or not at all, never a lone `@` for the next flush
+    bool Gateway::respond(int port, const char *payload)
+    {
+        size_t n = strlen(payload);
+        if (!isOpen(port) || n > USC_GATEWAY_OUTSIZE)
+        {
+            return false;
+        }
+        Port &p = _ports[port];
+        if ((p.nout + n > USC_GATEWAY_OUTSIZE || p.niov + 3 > USC_GATEWAY_IOV) && !flush(port))
+        {
+            return false;
+        }
+        return reply(port, "@", 1, false) && reply(port, payload, n) && reply(port, "$", 1, false);
+    }
+
+    bool Gateway::flush(int port)
+    {
+        if (!isOpen(port))
+        {
+            return false;
+        }
+        Port &p = _ports[port];
+        int first = 0;
+        while (first < p.niov)
+        {
+            ssize_t n = writev(p.fd, &p.iov[first], p.niov - first);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN)
+                {
+                    // the tty is busy, wait until it drained
+                    struct pollfd pfd;
+                    pfd.fd = p.fd;
+                    pfd.events = POLLOUT;
+                    if (::poll(&pfd, 1, 100) > 0)
+                    {
+                        continue;
+                    }
+                }
+                break;
+            }
+            // skip what was written, a segment may be written partially
+            while (first < p.niov && (size_t)n >= p.iov[first].iov_len)
+            {
+                n -= p.iov[first].iov_len;
+                first++;
+            }
+            if (first < p.niov)
+            {
+                p.iov[first].iov_base = (char *)p.iov[first].iov_base + n;
+                p.iov[first].iov_len -= n;
+            }
+        }
+        bool ok = first == p.niov;
+        p.niov = 0;
+        p.nout = 0;
+        return ok;
+    }
+
+    int Gateway::feed(int port, const char *buf, size_t n)
+    {
+        if (_capture)
+        {
+            _capture->write((uint8_t)port, buf, n);
+        }
+        Command &cmd = _ports[port].cmd;
+        int nf = 0;
+        while (n > 0)
+        {
+            Result res;
+            size_t used = cmd.process(buf, n, res);
+            buf += used;
+            n -= used;
+            if (res == OK)
+            {
+                if (!cmd.isResponse() && cmd.matchAddress())
+                {
+                    nf++;
+                    if (frameCb)
+                    {
+                        cmd.params().begin();
+                        frameCb(*this, port, cmd);
+                    }
+                }
+            }
+            else if (res != Next && errCb)
+            {
+                cmd.params().begin();
+                errCb(*this, port, res, cmd);
+            }
+        }
+        return nf;
+    }
+
+    int Gateway::poll(int timeoutMs)
+    {
+        int nf = _backend == IoUring ? pollRing(timeoutMs) : pollEpoll(timeoutMs);
+        for (int i = 0; i < _count; i++)
+        {
+            if (_ports[i].niov > 0)
+            {
+                flush(i);
+            }
+        }
+        return nf;
+    }
+
+    int Gateway::pollEpoll(int timeoutMs)
+    {
+        int nf = 0;
+
+        // files are read first, do not wait while they have data
+        for (int i = 0; i < _count; i++)
+        {
+            if (_ports[i].open && !_ports[i].pollable)
+            {
+                ssize_t n = read(_ports[i].fd, input(i), USC_GATEWAY_READSIZE);
+                if (n > 0)
+                {
+                    nf += feed(i, input(i), n);
+                    timeoutMs = 0;
+                }
+                else if (n == 0)
+                {
+                    close(i);
+                }
+            }
+        }
+
+        struct epoll_event events[32];
+        int ne = epoll_wait(_epoll, events, 32, timeoutMs);
+        for (int k = 0; k < ne; k++)
+        {
+            int port = events[k].data.u32;
+            for (;;)
+            {
+                ssize_t n = read(_ports[port].fd, input(port), USC_GATEWAY_READSIZE);
+                if (n > 0)
+                {
+                    nf += feed(port, input(port), n);
+                    continue;
+                }
+                if (n == 0 || (errno != EAGAIN && errno != EINTR))
+                {
+                    close(port);
+                }
+                break;
+            }
+        }
+        return ne < 0 && errno != EINTR ? -1 : nf;
+    }
+
+#if defined(USC_HAVE_URING)
+    bool Gateway::submitRead(int port)
+    {
+        struct io_uring_sqe *sqe = _ring->next();
+        if (!sqe)
+        {
+            return false;
+        }
+        sqe->opcode = _ring->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = _ports[port].fd;
+        sqe->addr = (uint64_t)(uintptr_t)input(port);
+        sqe->len = USC_GATEWAY_READSIZE;
+        sqe->off = (uint64_t)-1;
+        sqe->buf_index = 0;
+        sqe->user_data = port;
+        return true;
+    }
+
+    int Gateway::pollRing(int timeoutMs)
+    {
+        // ends the wait after the time or as soon as one read completed
+        if (timeoutMs >= 0)
+        {
+            struct io_uring_sqe *sqe = _ring->next();
+            if (sqe)
+            {
+                _ring->ts.tv_sec = timeoutMs / 1000;
+                _ring->ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->fd = -1;
+                sqe->addr = (uint64_t)(uintptr_t)&_ring->ts;
+                sqe->len = 1;
+                sqe->off = 1;
+                sqe->user_data = USC_TIMEOUT_TAG;
+            }
+        }
+        if (_ring->enter(1) < 0 && errno != EINTR)
+        {
+            return -1;
+        }
+
+        int nf = 0;
+        unsigned head = *_ring->cqHead;
+        unsigned tail = __atomic_load_n(_ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe &cqe = _ring->cqes[head & *_ring->cqMask];
+            if (cqe.user_data == USC_TIMEOUT_TAG)
+            {
+                continue;
+            }
+            int port = (int)cqe.user_data;
+            if (cqe.res > 0)
+            {
+                nf += feed(port, input(port), cqe.res);
+            }
+            if (cqe.res > 0 || cqe.res == -EAGAIN || cqe.res == -EINTR)
+            {
+                submitRead(port);
+            }
+            else
+            {
+                close(port);
+            }
+        }
+        __atomic_store_n(_ring->cqHead, head, __ATOMIC_RELEASE);
+
+        // queue the new reads right away
+        _ring->enter(0);
+        return nf;
+    }
+#else
+    bool Gateway::submitRead(int port)
+    {
+        (void)port;
+        return false;
+    }
+    int Gateway::pollRing(int timeoutMs)
+    {
+        (void)timeoutMs;
+        return -1;
+    }
+#endif
+};
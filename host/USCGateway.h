@@ -0,0 +1,101 @@
+#ifndef _USCGATEWAY_H_
+#define _USCGATEWAY_H_
+
+#include <sys/uio.h>
+#include "../src/USCommand.h"
+
+// bytes read from a port at once
+#ifndef USC_GATEWAY_READSIZE
+#define USC_GATEWAY_READSIZE 4096
+#endif
+
+// bytes and segments of responses queued per port until flushed
+#ifndef USC_GATEWAY_OUTSIZE
+#define USC_GATEWAY_OUTSIZE 1024
+#endif
+#ifndef USC_GATEWAY_IOV
+#define USC_GATEWAY_IOV 16
+#endif
+
+namespace usc
+{
+    class Gateway;
+    class CaptureWriter;
+
+    // callback type, port is the index returned by Gateway::add()
+    typedef void (*PortCb)(Gateway &gw, int port, Command &cmd);
+    typedef void (*PortErrorCb)(Gateway &gw, int port, Result res, Command &cmd);
+
+    // Reads tty, pty or file descriptors with io_uring (one registered buffer for all
+    // ports, fixed reads) or epoll, feeds each port to its own Command and writes the
+    // queued responses of a port with one writev() per poll.
+    class Gateway
+    {
+    public:
+        enum Backend
+        {
+            Auto,
+            Epoll,
+            IoUring
+        };
+
+        Gateway(int maxPorts, Backend backend = Auto);
+        ~Gateway();
+
+        Backend backend(void) const;
+        int add(int fd, uint32_t addr = 0);
+        int open(const char *path, uint32_t addr = 0);
+        bool isOpen(int port) const;
+        int ports(void) const;
+        Command &command(int port);
+        void attachCallback(PortCb fnFrame = nullptr, PortErrorCb fnErr = nullptr);
+        void attachCapture(CaptureWriter *cap);
+
+        bool reply(int port, const char *data, size_t n, bool copy = true);
+        bool respond(int port, const char *payload);
+        bool flush(int port);
+        int poll(int timeoutMs = -1);
+#if USC_STATS
+        void snapshot(Stats &total) const;
+#endif
+
+    private:
+        struct Port
+        {
+            int fd;
+            bool open;
+            bool pollable;
+            bool owned;
+            Command cmd;
+            size_t nout;
+            int niov;
+            char out[USC_GATEWAY_OUTSIZE];
+            struct iovec iov[USC_GATEWAY_IOV];
+        };
+        struct Ring;
+
+        Backend _backend;
+        int _max;
+        int _count;
+        Port *_ports;
+        char *_in;
+        int _epoll;
+        Ring *_ring;
+        CaptureWriter *_capture;
+        PortCb frameCb;
+        PortErrorCb errCb;
+
+        Gateway(const Gateway &);
+        Gateway &operator=(const Gateway &);
+
+        char *input(int port);
+        int feed(int port, const char *buf, size_t n);
+        void close(int port);
+        int pollEpoll(int timeoutMs);
+        int pollRing(int timeoutMs);
+        bool setupRing(void);
+        bool submitRead(int port);
+    };
+};
+
+#endif
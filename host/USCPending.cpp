@@ -0,0 +1,159 @@
+#include <chrono>
+#include "USCPending.h"
+
+// capacity is a power of two dividing the id space, so `id % capacity` stays stable
+// when ids wrap around
+#define USC_PENDING_MAX 32768
+
+namespace usc
+{
+    PendingTable::PendingTable(uint16_t capacity, ReplyCb fnReply)
+        : _count(0), _next(1), _first(UINT64_MAX), replyCb(fnReply)
+    {
+        uint32_t n = 1;
+        while (n < capacity && n < USC_PENDING_MAX)
+        {
+            n <<= 1;
+        }
+        _mask = (uint16_t)(n - 1);
+        _slots = new Slot[n];
+        for (uint32_t i = 0; i < n; i++)
+        {
+            _slots[i].used = false;
+        }
+    }
+    PendingTable::~PendingTable()
+    {
+        delete[] _slots;
+    }
+
+    uint64_t PendingTable::clock(void)
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    uint16_t PendingTable::size(void) const
+    {
+        return _count;
+    }
+    uint16_t PendingTable::capacity(void) const
+    {
+        return _mask + 1;
+    }
+
+    // id for the next request, -1 when all slots are waiting
+    int PendingTable::add(uint32_t timeoutMs, void *ctx, uint64_t now)
+    {
+        if (_count > _mask)
+        {
+            return -1;
+        }
+        uint16_t id = _next;
+        while (_slots[id & _mask].used)
+        {
+            id++;
+        }
+        _next = id + 1;
+
+        Slot &s = _slots[id & _mask];
+        s.deadline = now + timeoutMs;
+        s.ctx = ctx;
+        s.id = id;
+        s.used = true;
+        _count++;
+        if (s.deadline < _first)
+        {
+            _first = s.deadline;
+        }
+        return id;
+    }
+
+    bool PendingTable::isPending(uint16_t id) const
+    {
+        const Slot &s = _slots[id & _mask];
+        return s.used && s.id == id;
+    }
+
+    // false for responses without id, late ones and ids never handed out
+    bool PendingTable::complete(const FrameView &resp)
+    {
+        if (!resp.isResponse() || !resp.hasId() || !isPending(resp.id()))
+        {
+            return false;
+        }
+        // free the slot first, the callback may send the next request
+        Slot &s = _slots[resp.id() & _mask];
+        s.used = false;
+        _count--;
+        if (replyCb)
+        {
+            replyCb(*this, s.id, s.ctx, &resp);
+        }
+        return true;
+    }
+
+    bool PendingTable::cancel(uint16_t id)
+    {
+        if (!isPending(id))
+        {
+            return false;
+        }
+        _slots[id & _mask].used = false;
+        _count--;
+        return true;
+    }
+
+    int PendingTable::expire(uint64_t now)
+    {
+        if (_count == 0 || now < _first)
+        {
+            return 0;
+        }
+
+        // requests added by the callback lower _first themselves
+        int n = 0;
+        _first = UINT64_MAX;
+        for (uint32_t i = 0; i <= _mask; i++)
+        {
+            Slot &s = _slots[i];
+            if (!s.used)
+            {
+                continue;
+            }
+            if (s.deadline > now)
+            {
+                if (s.deadline < _first)
+                {
+                    _first = s.deadline;
+                }
+                continue;
+            }
+            s.used = false;
+            _count--;
+            n++;
+            if (replyCb)
+            {
+                replyCb(*this, s.id, s.ctx, nullptr);
+            }
+        }
+        return n;
+    }
+
+    // milliseconds until expire() has work, -1 while nothing is pending, e.g. for
+    // Gateway::poll()
+    int PendingTable::nextTimeout(uint64_t now) const
+    {
+        if (_count == 0)
+        {
+            return -1;
+        }
+        if (_first <= now)
+        {
+            return 0;
+        }
+        uint64_t ms = _first - now;
+        return ms > INT32_MAX ? INT32_MAX : (int)ms;
+    }
+};
@@ -0,0 +1,57 @@
+#ifndef _USCPENDING_H_
+#define _USCPENDING_H_
+
+#include "../src/USCommand.h"
+#include "../src/USCView.h"
+
+namespace usc
+{
+    class PendingTable;
+
+    // callback type, resp is nullptr when the request timed out
+    typedef void (*ReplyCb)(PendingTable &tbl, uint16_t id, void *ctx, const FrameView *resp);
+
+    // Requests sent on one bus and not answered yet. add() hands out the id to write into
+    // the request (`#id`), the response echoing that id completes it and expire() ends the
+    // requests past their deadline, so many requests can be in flight and answered in any
+    // order. Id `i` lives in slot `i % capacity`, the ids of waiting requests are skipped
+    // when new ones are handed out. Times are milliseconds of clock().
+    class PendingTable
+    {
+    public:
+        PendingTable(uint16_t capacity, ReplyCb fnReply);
+        ~PendingTable();
+
+        int add(uint32_t timeoutMs, void *ctx = nullptr, uint64_t now = clock());
+        bool complete(const FrameView &resp);
+        bool cancel(uint16_t id);
+        int expire(uint64_t now = clock());
+        bool isPending(uint16_t id) const;
+        uint16_t size(void) const;
+        uint16_t capacity(void) const;
+        int nextTimeout(uint64_t now = clock()) const;
+
+        static uint64_t clock(void);
+
+    private:
+        struct Slot
+        {
+            uint64_t deadline;
+            void *ctx;
+            uint16_t id;
+            bool used;
+        };
+
+        Slot *_slots;
+        uint16_t _mask;
+        uint16_t _count;
+        uint16_t _next;
+        uint64_t _first;
+        ReplyCb replyCb;
+
+        PendingTable(const PendingTable &);
+        PendingTable &operator=(const PendingTable &);
+    };
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef _USCRING_H_
+#define _USCRING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#define USC_CACHE_LINE 64
+
+namespace usc
+{
+    // Bounded lock-free queue for exactly one producer and one consumer thread.
+    // N must be a power of two.
+    template <typename T, size_t N>
+    class SpscRing
+    {
+        static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+
+    public:
+        SpscRing()
+            : _head(0), _tailCache(0), _tail(0), _headCache(0)
+        {
+        }
+
+        bool push(const T &v)
+        {
+            size_t t = _tail.load(std::memory_order_relaxed);
+            if (t - _headCache == N)
+            {
+                _headCache = _head.load(std::memory_order_acquire);
+                if (t - _headCache == N)
+                {
+                    return false;
+                }
+            }
+            _buf[t & (N - 1)] = v;
+            _tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T &v)
+        {
+            size_t h = _head.load(std::memory_order_relaxed);
+            if (h == _tailCache)
+            {
+                _tailCache = _tail.load(std::memory_order_acquire);
+                if (h == _tailCache)
+                {
+                    return false;
+                }
+            }
+            v = _buf[h & (N - 1)];
+            _head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool empty(void) const
+        {
+            return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        // consumer and producer side on their own cache lines, padded instead of
+        // aligned so the rings can live in plain new'ed memory
+        char _pad0[USC_CACHE_LINE];
+        std::atomic<size_t> _head;
+        size_t _tailCache;
+        char _pad1[USC_CACHE_LINE];
+        std::atomic<size_t> _tail;
+        size_t _headCache;
+        char _pad2[USC_CACHE_LINE];
+        T _buf[N];
+    };
+
+    // Bounded lock-free queue for any number of producers and consumers, every cell
+    // carries a sequence number telling whether it is free or filled for a lap.
+    // N must be a power of two.
+    template <typename T, size_t N>
+    class MpmcRing
+    {
+        static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+
+    public:
+        MpmcRing()
+            : _enqueue(0), _dequeue(0)
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                _cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool push(const T &v)
+        {
+            Cell *c;
+            size_t pos = _enqueue.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                c = &_cells[pos & (N - 1)];
+                size_t seq = c->seq.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+                if (dif == 0)
+                {
+                    if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (dif < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = _enqueue.load(std::memory_order_relaxed);
+                }
+            }
+            c->data = v;
+            c->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T &v)
+        {
+            Cell *c;
+            size_t pos = _dequeue.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                c = &_cells[pos & (N - 1)];
+                size_t seq = c->seq.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (dif == 0)
+                {
+                    if (_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (dif < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = _dequeue.load(std::memory_order_relaxed);
+                }
+            }
+            v = c->data;
+            c->seq.store(pos + N, std::memory_order_release);
+            return true;
+        }
+
+        bool empty(void) const
+        {
+            size_t pos = _dequeue.load(std::memory_order_acquire);
+            return (intptr_t)_cells[pos & (N - 1)].seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1) < 0;
+        }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> seq;
+            T data;
+        };
+
+        char _pad0[USC_CACHE_LINE];
+        std::atomic<size_t> _enqueue;
+        char _pad1[USC_CACHE_LINE];
+        std::atomic<size_t> _dequeue;
+        char _pad2[USC_CACHE_LINE];
+        Cell _cells[N];
+    };
+};
+
+#endif
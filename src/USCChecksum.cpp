@@ -0,0 +1,102 @@
+#include "USCChecksum.h"
+
+namespace usc
+{
+    namespace check
+    {
+#if USC_CHECKSUM == USC_CHECKSUM_CRC8
+        // one byte, most significant bit first
+        static constexpr uint8_t bits(uint8_t c, int k = 8)
+        {
+            return k == 0 ? c : bits((c & 0x80) ? (uint8_t)((c << 1) ^ 0x07) : (uint8_t)(c << 1), k - 1);
+        }
+        // byte i followed by k zero bytes
+        static constexpr Value crcOf(int i, int k)
+        {
+            return k == 0 ? bits((uint8_t)i) : bits(crcOf(i, k - 1));
+        }
+#elif USC_CHECKSUM == USC_CHECKSUM_CRC16
+        // one byte, least significant bit first
+        static constexpr uint16_t bits(uint16_t c, int k = 8)
+        {
+            return k == 0 ? c : bits((c & 1) ? (uint16_t)((c >> 1) ^ 0xA001) : (uint16_t)(c >> 1), k - 1);
+        }
+        // c followed by a zero byte
+        static constexpr Value zero(uint16_t c)
+        {
+            return (c >> 8) ^ bits(c & 0xFF);
+        }
+        static constexpr Value crcOf(int i, int k)
+        {
+            return k == 0 ? bits((uint16_t)i) : zero(crcOf(i, k - 1));
+        }
+#endif
+
+#if USC_CHECKSUM != USC_CHECKSUM_XOR
+#define USC_K4(n, k) crcOf(n, k), crcOf(n + 1, k), crcOf(n + 2, k), crcOf(n + 3, k)
+#define USC_K16(n, k) USC_K4(n, k), USC_K4(n + 4, k), USC_K4(n + 8, k), USC_K4(n + 12, k)
+#define USC_K64(n, k) USC_K16(n, k), USC_K16(n + 16, k), USC_K16(n + 32, k), USC_K16(n + 48, k)
+#define USC_SLICE(k) {USC_K64(0, k), USC_K64(64, k), USC_K64(128, k), USC_K64(192, k)}
+
+#if defined(__AVR__)
+        const Value Table[1][256] PROGMEM = {USC_SLICE(0)};
+#else
+        const Value Table[USC_CHECK_SLICES][256] = {
+            USC_SLICE(0), USC_SLICE(1), USC_SLICE(2), USC_SLICE(3),
+            USC_SLICE(4), USC_SLICE(5), USC_SLICE(6), USC_SLICE(7)};
+#endif
+
+#undef USC_SLICE
+#undef USC_K64
+#undef USC_K16
+#undef USC_K4
+
+        Value update(Value c, const char *p, size_t n)
+        {
+            const uint8_t *b = (const uint8_t *)p;
+#if USC_CHECK_SLICES == 8
+            // eight bytes per round, each table adds the bytes still following
+            for (; n >= 8; n -= 8, b += 8)
+            {
+#if USC_CHECKSUM == USC_CHECKSUM_CRC16
+                uint16_t x = c ^ (uint16_t)(b[0] | (b[1] << 8));
+                c = Table[7][x & 0xFF] ^ Table[6][x >> 8] ^ Table[5][b[2]] ^ Table[4][b[3]] ^
+                    Table[3][b[4]] ^ Table[2][b[5]] ^ Table[1][b[6]] ^ Table[0][b[7]];
+#else
+                c = Table[7][c ^ b[0]] ^ Table[6][b[1]] ^ Table[5][b[2]] ^ Table[4][b[3]] ^
+                    Table[3][b[4]] ^ Table[2][b[5]] ^ Table[1][b[6]] ^ Table[0][b[7]];
+#endif
+            }
+#endif
+            for (; n != 0; n--)
+            {
+                c = step(c, (char)*b++);
+            }
+            return c;
+        }
+#endif
+
+        uint8_t format(Value c, char *buf)
+        {
+            if (Hex)
+            {
+                static const char digits[] = "0123456789ABCDEF";
+                for (int i = Digits - 1; i >= 0; i--)
+                {
+                    buf[i] = digits[c & 0x0F];
+                    c >>= 4;
+                }
+                return Digits;
+            }
+
+            // decimal without leading zeros
+            uint8_t n = c >= 100 ? 3 : c >= 10 ? 2 : 1;
+            for (int i = n - 1; i >= 0; i--)
+            {
+                buf[i] = '0' + c % 10;
+                c /= 10;
+            }
+            return n;
+        }
+    };
+};
@@ -0,0 +1,100 @@
+#ifndef _USCCHECKSUM_H_
+#define _USCCHECKSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "USCScan.h"
+
+// Integrity check written after `|`, over every byte from the start marker up to and
+// including the `|`. XOR is written as a decimal number, the CRCs as fixed width hex.
+//   CRC-8:  CRC-8/SMBUS, poly 0x07, init 0x00
+//   CRC-16: CRC-16/MODBUS, poly 0x8005 reflected, init 0xFFFF
+#define USC_CHECKSUM_XOR 0
+#define USC_CHECKSUM_CRC8 1
+#define USC_CHECKSUM_CRC16 2
+
+#ifndef USC_CHECKSUM
+#define USC_CHECKSUM USC_CHECKSUM_XOR
+#endif
+
+namespace usc
+{
+    namespace check
+    {
+#if USC_CHECKSUM == USC_CHECKSUM_CRC16
+        typedef uint16_t Value;
+        constexpr Value Init = 0xFFFF;
+        constexpr uint8_t Digits = 4;
+#elif USC_CHECKSUM == USC_CHECKSUM_CRC8
+        typedef uint8_t Value;
+        constexpr Value Init = 0;
+        constexpr uint8_t Digits = 2;
+#else
+        typedef uint8_t Value;
+        constexpr Value Init = 0;
+        constexpr uint8_t Digits = 3;
+#endif
+        constexpr bool Hex = USC_CHECKSUM != USC_CHECKSUM_XOR;
+        constexpr uint32_t Max = (Value)~0;
+
+#if USC_CHECKSUM != USC_CHECKSUM_XOR
+        // table of one byte, on the host followed by the tables of slice-by-8, where
+        // table k holds the CRC of byte i followed by k zero bytes
+#if defined(__AVR__)
+#define USC_CHECK_SLICES 1
+        extern const Value Table[1][256] PROGMEM;
+
+        static inline Value entry(uint8_t i)
+        {
+#if USC_CHECKSUM == USC_CHECKSUM_CRC16
+            return pgm_read_word(&Table[0][i]);
+#else
+            return pgm_read_byte(&Table[0][i]);
+#endif
+        }
+#else
+#define USC_CHECK_SLICES 8
+        extern const Value Table[USC_CHECK_SLICES][256];
+
+        static inline Value entry(uint8_t i)
+        {
+            return Table[0][i];
+        }
+#endif
+#endif
+
+        static inline Value step(Value c, char b)
+        {
+#if USC_CHECKSUM == USC_CHECKSUM_CRC16
+            return (c >> 8) ^ entry((uint8_t)(c ^ (uint8_t)b));
+#elif USC_CHECKSUM == USC_CHECKSUM_CRC8
+            return entry(c ^ (uint8_t)b);
+#else
+            return c ^ (uint8_t)b;
+#endif
+        }
+
+#if USC_CHECKSUM == USC_CHECKSUM_XOR
+        static inline Value update(Value c, const char *p, size_t n)
+        {
+            return scan::xorBytes(p, n, c);
+        }
+#else
+        Value update(Value c, const char *p, size_t n);
+#endif
+
+        static inline bool isDigit(char c)
+        {
+            return Hex ? scan::is(c, scan::cHex) : scan::is(c, scan::cDigit);
+        }
+        static inline uint8_t digitOf(char c)
+        {
+            return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+        }
+
+        // writes the field without terminator, returns its length
+        uint8_t format(Value c, char *buf);
+    };
+};
+
+#endif
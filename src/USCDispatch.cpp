@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include <string.h>
+#include "USCDispatch.h"
+
+static inline uint32_t mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6BUL;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35UL;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline uint32_t keyOf(uint16_t component, uint32_t hash)
+{
+    return hash ^ ((uint32_t)component * 0x9E3779B1UL);
+}
+
+namespace usc
+{
+    Dispatcher::Dispatcher(const Route *routes, uint16_t count, uint8_t *disp, uint16_t buckets,
+                           uint16_t *slots, uint16_t nslots)
+        : _routes(routes), _count(count), _disp(disp), _buckets(buckets),
+          _slots(slots), _mask(nslots - 1), _ready(false)
+    {
+    }
+
+    uint16_t Dispatcher::bucketOf(uint32_t key) const
+    {
+        return mix(key) % _buckets;
+    }
+    uint16_t Dispatcher::slotOf(uint32_t key, uint8_t d) const
+    {
+        return mix(key ^ ((uint32_t)d * 0x27D4EB2FUL + d)) & _mask;
+    }
+
+    bool Dispatcher::place(uint16_t b, const uint32_t *keys)
+    {
+        // try displacements until every route of the bucket lands in a free slot
+        for (uint16_t d = 0; d <= 255; d++)
+        {
+            uint16_t n = 0;
+            bool ok = true;
+            for (uint16_t i = 0; i < _count && ok; i++)
+            {
+                uint32_t key = keys[i];
+                if (bucketOf(key) != b)
+                {
+                    continue;
+                }
+                uint16_t s = slotOf(key, d);
+                if (_slots[s] != 0)
+                {
+                    ok = false;
+                    break;
+                }
+                _slots[s] = i + 1;
+                n++;
+            }
+            if (ok)
+            {
+                _disp[b] = d;
+                return true;
+            }
+
+            // roll back this attempt
+            for (uint16_t s = 0; s <= _mask && n > 0; s++)
+            {
+                uint16_t i = _slots[s];
+                if (i != 0 && bucketOf(keys[i - 1]) == b)
+                {
+                    _slots[s] = 0;
+                    n--;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool Dispatcher::build(uint32_t *keys)
+    {
+        _ready = false;
+        memset(_slots, 0, sizeof(uint16_t) * (_mask + 1));
+        memset(_disp, 0, _buckets);
+
+        // duplicated routes can never be placed, schemas must fit the args buffer
+        for (uint16_t i = 0; i < _count; i++)
+        {
+            const Schema *sc = _routes[i].schema;
+            if (sc != nullptr && (sc->size > USC_ARGSIZE || sc->count > 32))
+            {
+                return false;
+            }
+            for (uint16_t j = i + 1; j < _count; j++)
+            {
+                if (_routes[i].component == _routes[j].component &&
+                    strcmp(_routes[i].action, _routes[j].action) == 0)
+                {
+                    return false;
+                }
+            }
+            keys[i] = keyOf(_routes[i].component, hash(_routes[i].action));
+        }
+
+        // place the largest buckets first
+        uint16_t largest = 0;
+        for (uint16_t b = 0; b < _buckets; b++)
+        {
+            uint16_t n = 0;
+            for (uint16_t i = 0; i < _count; i++)
+            {
+                if (bucketOf(keys[i]) == b)
+                {
+                    n++;
+                }
+            }
+            if (n > largest)
+            {
+                largest = n;
+            }
+        }
+        for (uint16_t size = largest; size > 0; size--)
+        {
+            for (uint16_t b = 0; b < _buckets; b++)
+            {
+                uint16_t n = 0;
+                for (uint16_t i = 0; i < _count; i++)
+                {
+                    if (bucketOf(keys[i]) == b)
+                    {
+                        n++;
+                    }
+                }
+                if (n == size && !place(b, keys))
+                {
+                    return false;
+                }
+            }
+        }
+
+        _ready = true;
+        return true;
+    }
+
+    bool Dispatcher::ready(void) const
+    {
+        return _ready;
+    }
+
+    const Route *Dispatcher::find(uint16_t component, const char *action, uint32_t hash) const
+    {
+        if (!_ready)
+        {
+            return nullptr;
+        }
+        uint32_t key = keyOf(component, hash);
+        uint16_t i = _slots[slotOf(key, _disp[bucketOf(key)])];
+        if (i == 0)
+        {
+            return nullptr;
+        }
+        const Route *r = &_routes[i - 1];
+        if (r->component != component || strcmp(r->action, action) != 0)
+        {
+            return nullptr;
+        }
+        return r;
+    }
+
+    const Route *Dispatcher::find(uint16_t component, const char *action) const
+    {
+        return find(component, action, hash(action));
+    }
+
+    // OK when a handler ran, Next without route and Invalid when the schema rejected the params
+    Result Dispatcher::invoke(Command &cmd) const
+    {
+        const Route *r = find(cmd.component(), cmd.action(), cmd.actionHash());
+        if (r == nullptr || r->handler == nullptr)
+        {
+            return Next;
+        }
+        Params &pars = cmd.params();
+        if (r->schema == nullptr)
+        {
+            r->handler(cmd, pars);
+            return OK;
+        }
+
+        union
+        {
+            uint8_t bytes[USC_ARGSIZE];
+            long l;
+            double d;
+            void *p;
+        } args;
+        if (bindParams(*r->schema, pars, &args) != OK)
+        {
+            return Invalid;
+        }
+        pars._args = &args;
+        r->handler(cmd, pars);
+        pars._args = nullptr;
+        return OK;
+    }
+
+    bool Dispatcher::dispatch(Command &cmd) const
+    {
+        return invoke(cmd) == OK;
+    }
+
+    Result dispatchCommand(const Dispatcher *dispatcher, Command &cmd)
+    {
+        return dispatcher->invoke(cmd);
+    }
+
+    // value of a numeric field, false unless the whole text is an optional '-' and digits,
+    // for floats with at most one '.', the way the encoder writes numbers
+    static bool toNumber(const KeyVal &kv, uint8_t type, double &v)
+    {
+        const char *s = kv.value();
+        const char *e = s + kv.valueLength();
+        bool digits = false;
+        bool dot = false;
+        for (const char *p = *s == '-' ? s + 1 : s; p != e; p++)
+        {
+            if (scan::is(*p, scan::cDigit))
+            {
+                digits = true;
+            }
+            else if (*p == '.' && type == FieldFloat && !dot)
+            {
+                dot = true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if (!digits)
+        {
+            return false;
+        }
+        v = type == FieldFloat ? strtod(s, nullptr) : strtol(s, nullptr, 10);
+        return true;
+    }
+
+    static void store(const Field &f, void *args, double v, const char *s)
+    {
+        uint8_t *p = (uint8_t *)args + f.offset;
+        switch (f.type)
+        {
+        case FieldInt:
+            *(int *)p = (int)v;
+            break;
+        case FieldLong:
+            *(long *)p = (long)v;
+            break;
+        case FieldFloat:
+            *(float *)p = (float)v;
+            break;
+        case FieldString:
+            *(const char **)p = s;
+            break;
+        case FieldFlag:
+            *(bool *)p = v != 0;
+            break;
+        }
+    }
+
+    Result bindParams(const Schema &schema, const Params &pars, void *args)
+    {
+        for (uint8_t i = 0; i < schema.count; i++)
+        {
+            const Field &f = schema.fields[i];
+            store(f, args, f.type == FieldFlag ? 0 : f.def, "");
+        }
+
+        // one pass over the param index of the parser
+        uint32_t seen = 0;
+        for (int k = 0; k < pars.count(); k++)
+        {
+            KeyVal kv = pars[k];
+            uint8_t i = 0;
+            for (; i < schema.count; i++)
+            {
+                const char *key = schema.fields[i].key;
+                if (strncmp(key, kv.key(), kv.keyLength()) == 0 && key[kv.keyLength()] == 0)
+                {
+                    break;
+                }
+            }
+            if (i == schema.count || (seen & (1UL << i)) != 0)
+            {
+                return Invalid;
+            }
+            seen |= 1UL << i;
+
+            const Field &f = schema.fields[i];
+            double v = 1;
+            if (f.type == FieldString)
+            {
+                if (kv.valueLength() < f.min || kv.valueLength() > f.max)
+                {
+                    return Invalid;
+                }
+                store(f, args, 0, kv.safeValue());
+                continue;
+            }
+            if (f.type == FieldFlag && !kv.hasValue())
+            {
+                store(f, args, v, nullptr);
+                continue;
+            }
+            if (!kv.hasValue() || !toNumber(kv, f.type, v))
+            {
+                return Invalid;
+            }
+            if (f.type == FieldFlag ? (v != 0 && v != 1) : (v < f.min || v > f.max))
+            {
+                return Invalid;
+            }
+            store(f, args, v, nullptr);
+        }
+
+        for (uint8_t i = 0; i < schema.count; i++)
+        {
+            if (schema.fields[i].required && (seen & (1UL << i)) == 0)
+            {
+                return Invalid;
+            }
+        }
+        return OK;
+    }
+
+    Vocabulary::Vocabulary(const char *const *words, uint8_t count, uint32_t *hashes)
+        : _words(words), _hashes(hashes), _count(count)
+    {
+    }
+
+    void Vocabulary::index(void)
+    {
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            _hashes[i] = hash(_words[i]);
+        }
+    }
+
+    uint8_t Vocabulary::size(void) const
+    {
+        return _count;
+    }
+    const char *Vocabulary::word(uint8_t id) const
+    {
+        return id < _count ? _words[id] : "";
+    }
+
+    uint8_t Vocabulary::find(const char *s, size_t n) const
+    {
+        uint32_t h = USC_HASH_BASIS;
+        for (size_t i = 0; i < n; i++)
+        {
+            h = hashStep(h, s[i]);
+        }
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if (_hashes[i] == h && strncmp(_words[i], s, n) == 0 && _words[i][n] == 0)
+            {
+                return i;
+            }
+        }
+        return UnknownSegment;
+    }
+    uint8_t Vocabulary::find(const char *word) const
+    {
+        return find(word, strlen(word));
+    }
+
+    uint8_t internSegment(const Vocabulary *vocab, const char *s, size_t n)
+    {
+        return vocab->find(s, n);
+    }
+};
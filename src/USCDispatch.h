@@ -0,0 +1,166 @@
+#ifndef _USCDISPATCH_H_
+#define _USCDISPATCH_H_
+
+#include "USCommand.h"
+
+// largest struct a Schema binds params into, it lives on the stack while the handler runs
+#ifndef USC_ARGSIZE
+#if defined(__AVR__)
+#define USC_ARGSIZE 32
+#else
+#define USC_ARGSIZE 64
+#endif
+#endif
+
+namespace usc
+{
+    typedef void (*ActionCb)(Command &, Params &);
+
+    enum FieldType
+    {
+        FieldInt,    // int, min..max
+        FieldLong,   // long, min..max
+        FieldFloat,  // float, min..max
+        FieldString, // const char * into the command buffer, length min..max
+        FieldFlag    // bool, true for a key without value, else the value 0 or 1
+    };
+
+    // One param of a Schema, written to `offset` of the args struct. Fields which are
+    // not required get `def` (strings ""), a flag false.
+    struct Field
+    {
+        const char *key;
+        uint8_t type;
+        uint16_t offset;
+        bool required;
+        double min;
+        double max;
+        double def;
+    };
+
+    // Params accepted by an action. size is sizeof the args struct, at most USC_ARGSIZE,
+    // and count at most 32. Unknown or repeated keys, values which are not a number of
+    // the type or out of range and missing required params reject the frame, process()
+    // returns Invalid for it. Numbers are an optional '-' and digits, floats with one '.'.
+    struct Schema
+    {
+        const Field *fields;
+        uint8_t count;
+        uint16_t size;
+    };
+
+    Result bindParams(const Schema &schema, const Params &pars, void *args);
+
+    struct Route
+    {
+        uint16_t component;
+        const char *action;
+        ActionCb handler;
+        const Schema *schema;
+    };
+
+    // Maps (component, action) to a handler through a perfect hash built by build().
+    // Lookup uses the action hash computed by Command while parsing and a single
+    // string compare to reject unregistered actions. Routes with a Schema bind the
+    // params before the handler runs, which reads them through Params::args().
+    // build() hashes every action once into keys, one entry per route, which are only
+    // needed while it runs.
+    class Dispatcher
+    {
+    public:
+        Dispatcher(const Route *routes, uint16_t count, uint8_t *disp, uint16_t buckets,
+                   uint16_t *slots, uint16_t nslots);
+
+        bool build(uint32_t *keys);
+        bool ready(void) const;
+        const Route *find(uint16_t component, const char *action) const;
+        const Route *find(uint16_t component, const char *action, uint32_t hash) const;
+        bool dispatch(Command &cmd) const;
+        Result invoke(Command &cmd) const;
+
+    private:
+        const Route *_routes;
+        uint16_t _count;
+        uint8_t *_disp;
+        uint16_t _buckets;
+        uint16_t *_slots;
+        uint16_t _mask;
+        bool _ready;
+
+        uint16_t bucketOf(uint32_t key) const;
+        uint16_t slotOf(uint32_t key, uint8_t d) const;
+        bool place(uint16_t b, const uint32_t *keys);
+    };
+
+    // Words used in action segments. Command::segmentId() interns every segment of a
+    // completed action to the index of its word, so routing on `/motor/left/speed`
+    // compares small integers. Lookup compares hashes first, then the matching word.
+    class Vocabulary
+    {
+    public:
+        Vocabulary(const char *const *words, uint8_t count, uint32_t *hashes);
+
+        uint8_t size(void) const;
+        const char *word(uint8_t id) const;
+        uint8_t find(const char *word) const;
+        uint8_t find(const char *s, size_t n) const;
+
+    protected:
+        void index(void);
+
+    private:
+        const char *const *_words;
+        uint32_t *_hashes;
+        uint8_t _count;
+    };
+
+    // Vocabulary with its own storage for N words, ids follow the order of words.
+    template <uint8_t N>
+    class VocabularyTable : public Vocabulary
+    {
+        static_assert(N < UnknownSegment, "too many words");
+
+    public:
+        VocabularyTable(const char *const (&words)[N])
+            : Vocabulary(words, N, _hashes)
+        {
+            index();
+        }
+
+    private:
+        uint32_t _hashes[N];
+    };
+
+    constexpr uint16_t tableSize(uint16_t n, uint16_t m = 1)
+    {
+        return m >= n ? m : tableSize(n, m << 1);
+    }
+
+    // Dispatcher with its own storage for N routes, the keys of build() are on its stack.
+    template <uint16_t N>
+    class DispatchTable : public Dispatcher
+    {
+        static_assert(N > 0, "no routes");
+
+    public:
+        DispatchTable(const Route (&routes)[N])
+            : Dispatcher(routes, N, _disp, Buckets, _slots, Slots)
+        {
+        }
+
+        bool build(void)
+        {
+            uint32_t keys[N];
+            return Dispatcher::build(keys);
+        }
+
+    private:
+        static const uint16_t Slots = tableSize(N + N / 4 + 1);
+        static const uint16_t Buckets = (N + 1) / 2;
+
+        uint8_t _disp[Buckets];
+        uint16_t _slots[Slots];
+    };
+};
+
+#endif
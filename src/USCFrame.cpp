@@ -0,0 +1,165 @@
+#include <string.h>
+#include "USCFrame.h"
+
+// Frame::_flags bits
+enum
+{
+    fResponse = 0x01,
+    fChecksum = 0x02,
+    fId = 0x04
+};
+
+// round n up to a multiple of align, a power of two
+static inline size_t alignUp(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+namespace usc
+{
+    Arena::Arena(void *buf, size_t size)
+        : _buf((char *)buf), _size(size), _used(0)
+    {
+    }
+
+    void *Arena::alloc(size_t n, size_t align)
+    {
+        // align the address, the buffer itself may start anywhere
+        size_t at = alignUp((size_t)(_buf + _used), align) - (size_t)_buf;
+        if (at > _size || n > _size - at)
+        {
+            return nullptr;
+        }
+        _used = at + n;
+        return _buf + at;
+    }
+    void Arena::reset(void)
+    {
+        _used = 0;
+    }
+    size_t Arena::size(void) const
+    {
+        return _size;
+    }
+    size_t Arena::used(void) const
+    {
+        return _used;
+    }
+    size_t Arena::available(void) const
+    {
+        return _size - _used;
+    }
+
+    const Frame *Frame::create(Arena &arena, const Command &cmd)
+    {
+        // header, param index and bytes in one block, nothing is taken when it does not fit
+        uint8_t count = cmd._params._count;
+        size_t at = alignUp(sizeof(Frame), alignof(ParamEntry));
+        size_t dat = at + count * sizeof(ParamEntry);
+        size_t align = alignof(Frame) > alignof(ParamEntry) ? alignof(Frame) : alignof(ParamEntry);
+        char *mem = (char *)arena.alloc(dat + cmd._np + 1, align);
+        if (mem == nullptr)
+        {
+            return nullptr;
+        }
+
+        Frame *f = (Frame *)mem;
+        ParamEntry *index = (ParamEntry *)(mem + at);
+        char *data = mem + dat;
+        memcpy(index, cmd._params._index, count * sizeof(ParamEntry));
+        memcpy(data, cmd._data, cmd._np + 1);
+
+        f->_data = data;
+        f->_index = index;
+        f->_device = cmd._device;
+        f->_hash = cmd._hash;
+        f->_component = cmd._component;
+        f->_id = cmd._id;
+        f->_flags = (cmd.isResponse() ? fResponse : 0) | (cmd._hasChecksum ? fChecksum : 0) |
+                    (cmd._hasId ? fId : 0);
+        f->_checksum = cmd._checksum;
+        f->_action = cmd._action ? cmd._action - cmd._data : 0;
+        f->_len = cmd._np;
+        f->_count = count;
+        return f;
+    }
+
+    bool Frame::isBroadcast(void) const
+    {
+        return _device == USC_BROADCAST_ADDR;
+    }
+    bool Frame::isResponse(void) const
+    {
+        return (_flags & fResponse) != 0;
+    }
+    bool Frame::hasChecksum(void) const
+    {
+        return (_flags & fChecksum) != 0;
+    }
+    check::Value Frame::checksum(void) const
+    {
+        return _checksum;
+    }
+    uint32_t Frame::device(void) const
+    {
+        return _device;
+    }
+    uint16_t Frame::component(void) const
+    {
+        return _component;
+    }
+    bool Frame::hasId(void) const
+    {
+        return (_flags & fId) != 0;
+    }
+    uint16_t Frame::id(void) const
+    {
+        return _id;
+    }
+    bool Frame::hasAction(void) const
+    {
+        return _action != 0 && _data[_action] != 0;
+    }
+    const char *Frame::action(void) const
+    {
+        return _action ? _data + _action : "";
+    }
+    uint32_t Frame::actionHash(void) const
+    {
+        return _hash;
+    }
+    const char *Frame::data(void) const
+    {
+        return _data;
+    }
+    int Frame::length(void) const
+    {
+        return _len;
+    }
+    int Frame::count(void) const
+    {
+        return _count;
+    }
+
+    KeyVal Frame::operator[](int i) const
+    {
+        if (i >= 0 && i < _count)
+        {
+            return KeyVal(_data, _index[i]);
+        }
+        return KeyVal();
+    }
+    KeyVal Frame::find(const char *key) const
+    {
+        size_t n = strlen(key);
+        for (int i = 0; i < _count; i++)
+        {
+            const ParamEntry &en = _index[i];
+            if (en.klen == n && memcmp(_data + en.key, key, n) == 0)
+            {
+                return KeyVal(_data, en);
+            }
+        }
+        return KeyVal();
+    }
+};
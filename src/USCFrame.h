@@ -0,0 +1,81 @@
+#ifndef _USCFRAME_H_
+#define _USCFRAME_H_
+
+#include "USCommand.h"
+
+namespace usc
+{
+    // Bump allocator over a caller provided buffer. Nothing is freed on its own,
+    // reset() releases all allocations at once.
+    class Arena
+    {
+    public:
+        Arena(void *buf, size_t size);
+
+        void *alloc(size_t n, size_t align = sizeof(void *));
+        void reset(void);
+        size_t size(void) const;
+        size_t used(void) const;
+        size_t available(void) const;
+
+    private:
+        char *_buf;
+        size_t _size;
+        size_t _used;
+    };
+
+    // Arena with its own storage of N bytes.
+    template <size_t N>
+    class ArenaBuffer : public Arena
+    {
+    public:
+        ArenaBuffer()
+            : Arena(_mem, N)
+        {
+        }
+
+    private:
+        char _mem[N];
+    };
+
+    // Immutable copy of a completed frame, placed in an Arena with its bytes and param
+    // index. It stays valid while the parser goes on with the next frames, until the
+    // arena is reset.
+    class Frame
+    {
+    public:
+        static const Frame *create(Arena &arena, const Command &cmd);
+
+        bool isBroadcast(void) const;
+        bool isResponse(void) const;
+        bool hasChecksum(void) const;
+        check::Value checksum(void) const;
+        uint32_t device(void) const;
+        uint16_t component(void) const;
+        bool hasId(void) const;
+        uint16_t id(void) const;
+        bool hasAction(void) const;
+        const char *action(void) const;
+        uint32_t actionHash(void) const;
+        const char *data(void) const;
+        int length(void) const;
+        int count(void) const;
+        KeyVal operator[](int i) const;
+        KeyVal find(const char *key) const;
+
+    private:
+        const char *_data;
+        const ParamEntry *_index;
+        uint32_t _device;
+        uint32_t _hash;
+        uint16_t _component;
+        uint16_t _id;
+        uint8_t _flags;
+        check::Value _checksum;
+        Offset _action;
+        Offset _len;
+        uint8_t _count;
+    };
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include <string.h>
+#include "USCPool.h"
+
+// CommandPool::Lanes::flags bits
+enum
+{
+    fCapture = 0x01,
+    fChecksum = 0x02,
+    fId = 0x04
+};
+
+namespace usc
+{
+    CommandPool::CommandPool(const Lanes &lanes, uint8_t n)
+        : _lanes(lanes), _n(n), _cmd(0), frameCb(nullptr), errCb(nullptr)
+    {
+    }
+
+    uint8_t CommandPool::size(void) const
+    {
+        return _n;
+    }
+
+    void CommandPool::attachCallback(StreamCb fnFrame, StreamErrorCb fnErr)
+    {
+        frameCb = fnFrame;
+        errCb = fnErr;
+    }
+
+    void CommandPool::clear(void)
+    {
+        for (uint8_t s = 0; s < _n; s++)
+        {
+            clear(s);
+        }
+    }
+    void CommandPool::clear(uint8_t stream)
+    {
+        if (stream >= _n)
+        {
+            return;
+        }
+        _cmd.clear();
+        store(stream);
+    }
+
+    void CommandPool::load(uint8_t s)
+    {
+        // between frames there is nothing to restore
+        _cmd.clear();
+        if (!Command::isOpen(_lanes.state[s]))
+        {
+            return;
+        }
+
+        const Lanes &l = _lanes;
+        _cmd._state = l.state[s];
+        _cmd._capture = (l.flags[s] & fCapture) != 0;
+        _cmd._hasChecksum = (l.flags[s] & fChecksum) != 0;
+        _cmd._hasId = (l.flags[s] & fId) != 0;
+        _cmd._pc = l.pc[s];
+        _cmd._np = l.np[s];
+        _cmd._ni = l.ni[s];
+        _cmd._nd = l.nd[s];
+#if USC_BINARY
+        _cmd._binPhase = l.binPhase[s];
+        _cmd._binFlags = l.binFlags[s];
+        _cmd._binLeft = l.binLeft[s];
+#endif
+        _cmd._checksum = l.checksum[s];
+        _cmd._error = l.error[s];
+        _cmd._discarded = l.discarded[s];
+        _cmd._action = l.action[s] ? _cmd._data + l.action[s] : nullptr;
+        _cmd._component = l.component[s];
+        _cmd._id = l.id[s];
+        _cmd._acc = l.acc[s];
+        _cmd._hash = l.hash[s];
+        _cmd._device = l.device[s];
+        memcpy(_cmd._data, l.data[s], _cmd._np + 1);
+
+        // entry `count` may hold the offset of a key in progress
+        Params &pars = _cmd._params;
+        uint8_t ne = l.count[s] < USC_MAXPARAMS ? l.count[s] + 1 : USC_MAXPARAMS;
+        memcpy(pars._index, l.index[s], ne * sizeof(ParamEntry));
+        pars._data = _cmd._data;
+        pars._count = l.count[s];
+    }
+
+    void CommandPool::store(uint8_t s)
+    {
+        const Lanes &l = _lanes;
+#if USC_STATS
+        // the shared parser only holds the counts of the last chunk
+        addStats(l.stats[s], _cmd._stats);
+        _cmd.resetStats();
+#endif
+        l.state[s] = _cmd._state;
+        if (!Command::isOpen(_cmd._state))
+        {
+            return;
+        }
+
+        l.flags[s] = (_cmd._capture ? fCapture : 0) | (_cmd._hasChecksum ? fChecksum : 0) |
+                     (_cmd._hasId ? fId : 0);
+        l.pc[s] = _cmd._pc;
+        l.np[s] = _cmd._np;
+        l.ni[s] = _cmd._ni;
+        l.nd[s] = _cmd._nd;
+#if USC_BINARY
+        l.binPhase[s] = _cmd._binPhase;
+        l.binFlags[s] = _cmd._binFlags;
+        l.binLeft[s] = _cmd._binLeft;
+#endif
+        l.checksum[s] = _cmd._checksum;
+        l.error[s] = _cmd._error;
+        l.discarded[s] = _cmd._discarded;
+        l.action[s] = _cmd._action ? _cmd._action - _cmd._data : 0;
+        l.component[s] = _cmd._component;
+        l.id[s] = _cmd._id;
+        l.acc[s] = _cmd._acc;
+        l.hash[s] = _cmd._hash;
+        l.device[s] = _cmd._device;
+        memcpy(l.data[s], _cmd._data, _cmd._np + 1);
+
+        const Params &pars = _cmd._params;
+        uint8_t ne = pars._count < USC_MAXPARAMS ? pars._count + 1 : USC_MAXPARAMS;
+        memcpy(l.index[s], pars._index, ne * sizeof(ParamEntry));
+        l.count[s] = pars._count;
+    }
+
+    int CommandPool::process(uint8_t stream, const char *buf, size_t n)
+    {
+        if (stream >= _n)
+        {
+            return 0;
+        }
+
+        load(stream);
+        int nf = 0;
+        while (n > 0)
+        {
+            Result res;
+            size_t k = _cmd.process(buf, n, res);
+            buf += k;
+            n -= k;
+            if (res == OK)
+            {
+                nf++;
+                if (frameCb)
+                {
+                    _cmd._params.begin();
+                    frameCb(stream, _cmd);
+                }
+            }
+            else if (res != Next && errCb)
+            {
+                _cmd._params.begin();
+                errCb(stream, res, _cmd);
+            }
+        }
+        store(stream);
+
+        return nf;
+    }
+
+    size_t CommandPool::process(uint8_t stream, const char *buf, size_t n, Result &res)
+    {
+        res = Next;
+        if (stream >= _n)
+        {
+            return n;
+        }
+
+        load(stream);
+        size_t used = _cmd.process(buf, n, res);
+        store(stream);
+        _cmd._params.begin();
+
+        return used;
+    }
+
+    Command &CommandPool::command(void)
+    {
+        return _cmd;
+    }
+
+#if USC_STATS
+    const Stats &CommandPool::stats(uint8_t stream) const
+    {
+        return _lanes.stats[stream < _n ? stream : 0];
+    }
+    void CommandPool::snapshot(Stats &total) const
+    {
+        memset(&total, 0, sizeof(total));
+        for (uint8_t s = 0; s < _n; s++)
+        {
+            addStats(total, _lanes.stats[s]);
+        }
+    }
+    void CommandPool::resetStats(void)
+    {
+        memset(_lanes.stats, 0, _n * sizeof(Stats));
+    }
+#endif
+};
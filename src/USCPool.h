@@ -0,0 +1,139 @@
+#ifndef _USCPOOL_H_
+#define _USCPOOL_H_
+
+#include "USCommand.h"
+
+namespace usc
+{
+    // callback type, stream is the index passed to CommandPool::process()
+    typedef void (*StreamCb)(uint8_t stream, Command &cmd);
+    typedef void (*StreamErrorCb)(uint8_t stream, Result res, Command &cmd);
+
+    // Parser states of many input streams served by one Command.
+    // The fields touched for every chunk are kept in one array per field, the frame
+    // buffers and param indexes of the streams are only copied while a frame is open
+    // or an error span is pending.
+    // Completed frames (commands and responses, any device) go to the shared callback,
+    // or, like Command::process(buf, n, res), stop the call and stay in command() until
+    // the next call.
+    class CommandPool
+    {
+    public:
+        uint8_t size(void) const;
+        void clear(void);
+        void clear(uint8_t stream);
+        int process(uint8_t stream, const char *buf, size_t n);
+        size_t process(uint8_t stream, const char *buf, size_t n, Result &res);
+        Command &command(void);
+        void attachCallback(StreamCb fnFrame = nullptr, StreamErrorCb fnErr = nullptr);
+#if USC_STATS
+        const Stats &stats(uint8_t stream) const;
+        void snapshot(Stats &total) const;
+        void resetStats(void);
+#endif
+
+    protected:
+        struct Lanes
+        {
+            uint8_t *state;
+            uint8_t *flags;
+            char *pc;
+            Offset *np;
+            uint8_t *ni;
+            uint8_t *nd;
+            uint8_t *count;
+            check::Value *checksum;
+            uint8_t *error;
+            Offset *action;
+            uint16_t *component;
+            uint16_t *id;
+            uint32_t *acc;
+            uint32_t *hash;
+            uint32_t *device;
+            uint32_t *discarded;
+            char (*data)[USC_BUFSIZE + 1];
+            ParamEntry (*index)[USC_MAXPARAMS];
+#if USC_BINARY
+            uint8_t *binPhase;
+            uint8_t *binFlags;
+            uint8_t *binLeft;
+#endif
+#if USC_STATS
+            Stats *stats;
+#endif
+        };
+
+        CommandPool(const Lanes &lanes, uint8_t n);
+
+    private:
+        Lanes _lanes;
+        uint8_t _n;
+        Command _cmd;
+        StreamCb frameCb;
+        StreamErrorCb errCb;
+
+        void load(uint8_t s);
+        void store(uint8_t s);
+    };
+
+    // CommandPool with its own storage for N streams.
+    template <uint8_t N>
+    class PoolTable : public CommandPool
+    {
+    public:
+        PoolTable()
+            : CommandPool(lanes(), N)
+        {
+            clear();
+#if USC_STATS
+            resetStats();
+#endif
+        }
+
+    private:
+        uint8_t _state[N];
+        uint8_t _flags[N];
+        char _pc[N];
+        Offset _np[N];
+        uint8_t _ni[N];
+        uint8_t _nd[N];
+        uint8_t _count[N];
+        check::Value _checksum[N];
+        uint8_t _error[N];
+        Offset _action[N];
+        uint16_t _component[N];
+        uint16_t _id[N];
+        uint32_t _acc[N];
+        uint32_t _hash[N];
+        uint32_t _device[N];
+        uint32_t _discarded[N];
+        char _data[N][USC_BUFSIZE + 1];
+        ParamEntry _index[N][USC_MAXPARAMS];
+#if USC_BINARY
+        uint8_t _binPhase[N];
+        uint8_t _binFlags[N];
+        uint8_t _binLeft[N];
+#endif
+#if USC_STATS
+        Stats _stats[N];
+#endif
+
+        Lanes lanes(void)
+        {
+            Lanes l = {_state, _flags, _pc, _np, _ni, _nd, _count, _checksum, _error, _action, _component, _id,
+                       _acc, _hash, _device, _discarded, _data, _index
+#if USC_BINARY
+                       ,
+                       _binPhase, _binFlags, _binLeft
+#endif
+#if USC_STATS
+                       ,
+                       _stats
+#endif
+            };
+            return l;
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "USCScan.h"
+
+namespace usc
+{
+    namespace scan
+    {
+        static constexpr bool isKeyChar(int c)
+        {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                   (c >= 'A' && c <= 'Z') || c == '-' || c == '_' || c == '.';
+        }
+        static constexpr bool isStructural(int c)
+        {
+            return c == '!' || c == '@' || c == '.' || c == ':' || c == '#' || c == '/' || c == '?' ||
+                   c == '=' || c == '&' || c == '|' || c == '$' || c == '\\';
+        }
+        static constexpr uint8_t classify(int c)
+        {
+            return (uint8_t)(((c >= '0' && c <= '9') ? cDigit : 0) |
+                             (isKeyChar(c) ? cKey : 0) |
+                             ((c == ' ' || c == '\r' || c == '\n' || c == '\t') ? cSpace : 0) |
+                             (isStructural(c) ? cStructural : 0) |
+                             ((c == '&' || c == '|' || c == '$' || c == '\\') ? cValueEnd : 0) |
+                             ((c == 'r' || c == 'n' || c == 't' || c == 'b' || c == '\\' ||
+                               c == '&' || c == '$' || c == '=' || c == '|')
+                                  ? cEscape
+                                  : 0) |
+                             ((c == '!' || c == '@' || c == USC_BINARY_START) ? cStart : 0) |
+                             (((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+                               (c >= 'A' && c <= 'F'))
+                                  ? cHex
+                                  : 0));
+        }
+
+#define USC_C4(n) classify(n), classify(n + 1), classify(n + 2), classify(n + 3)
+#define USC_C16(n) USC_C4(n), USC_C4(n + 4), USC_C4(n + 8), USC_C4(n + 12)
+#define USC_C64(n) USC_C16(n), USC_C16(n + 16), USC_C16(n + 32), USC_C16(n + 48)
+
+#if defined(__AVR__)
+        const uint8_t CharClass[256] PROGMEM = {
+#else
+        const uint8_t CharClass[256] = {
+#endif
+            USC_C64(0), USC_C64(64), USC_C64(128), USC_C64(192)};
+
+#undef USC_C64
+#undef USC_C16
+#undef USC_C4
+    };
+};
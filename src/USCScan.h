@@ -0,0 +1,392 @@
+#ifndef _USCSCAN_H_
+#define _USCSCAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define USC_SCAN_AVX2
+#define USC_SCAN_WIDTH 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define USC_SCAN_SSE2
+#define USC_SCAN_WIDTH 16
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define USC_SCAN_NEON
+#define USC_SCAN_WIDTH 16
+#else
+#define USC_SCAN_WIDTH 1
+#endif
+
+// start byte of a binary frame (STX)
+#define USC_BINARY_START 0x02
+
+namespace usc
+{
+    namespace scan
+    {
+        // character classes, one bit each
+        enum Class
+        {
+            cDigit = 0x01,      // 0-9
+            cKey = 0x02,        // 0-9 a-z A-Z - _ .
+            cSpace = 0x04,      // ' ' \r \n \t
+            cStructural = 0x08, // ! @ . : # / ? = & | $ \ (backslash)
+            cValueEnd = 0x10,   // & | $ \ (backslash)
+            cEscape = 0x20,     // characters allowed after backslash
+            cStart = 0x40,      // ! @ STX
+            cHex = 0x80         // 0-9 a-f A-F
+        };
+
+#if defined(__AVR__)
+        extern const uint8_t CharClass[256] PROGMEM;
+
+        static inline uint8_t classOf(char c)
+        {
+            return pgm_read_byte(&CharClass[(uint8_t)c]);
+        }
+#else
+        extern const uint8_t CharClass[256];
+
+        static inline uint8_t classOf(char c)
+        {
+            return CharClass[(uint8_t)c];
+        }
+#endif
+        static inline bool is(char c, uint8_t cls)
+        {
+            return (classOf(c) & cls) != 0;
+        }
+
+#if USC_SCAN_WIDTH > 1
+#if defined(USC_SCAN_AVX2)
+        typedef __m256i Vec;
+
+        static inline Vec load(const char *p)
+        {
+            return _mm256_loadu_si256((const __m256i *)p);
+        }
+        static inline Vec eq(Vec v, char c)
+        {
+            return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+        }
+        static inline Vec range(Vec v, char lo, char hi)
+        {
+            // ASCII only, bytes >= 0x80 compare negative and fall outside
+            return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+        }
+        static inline Vec lower(Vec v)
+        {
+            return _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        }
+        static inline Vec vor(Vec a, Vec b)
+        {
+            return _mm256_or_si256(a, b);
+        }
+        static inline uint32_t bits(Vec v)
+        {
+            return (uint32_t)_mm256_movemask_epi8(v);
+        }
+#elif defined(USC_SCAN_SSE2)
+        typedef __m128i Vec;
+
+        static inline Vec load(const char *p)
+        {
+            return _mm_loadu_si128((const __m128i *)p);
+        }
+        static inline Vec eq(Vec v, char c)
+        {
+            return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+        }
+        static inline Vec range(Vec v, char lo, char hi)
+        {
+            // ASCII only, bytes >= 0x80 compare negative and fall outside
+            return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                                 _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+        }
+        static inline Vec lower(Vec v)
+        {
+            return _mm_or_si128(v, _mm_set1_epi8(0x20));
+        }
+        static inline Vec vor(Vec a, Vec b)
+        {
+            return _mm_or_si128(a, b);
+        }
+        static inline uint32_t bits(Vec v)
+        {
+            return (uint32_t)_mm_movemask_epi8(v);
+        }
+#elif defined(USC_SCAN_NEON)
+        typedef uint8x16_t Vec;
+
+        static inline Vec load(const char *p)
+        {
+            return vld1q_u8((const uint8_t *)p);
+        }
+        static inline Vec eq(Vec v, char c)
+        {
+            return vceqq_u8(v, vdupq_n_u8((uint8_t)c));
+        }
+        static inline Vec range(Vec v, char lo, char hi)
+        {
+            return vandq_u8(vcgeq_u8(v, vdupq_n_u8((uint8_t)lo)),
+                            vcleq_u8(v, vdupq_n_u8((uint8_t)hi)));
+        }
+        static inline Vec lower(Vec v)
+        {
+            return vorrq_u8(v, vdupq_n_u8(0x20));
+        }
+        static inline Vec vor(Vec a, Vec b)
+        {
+            return vorrq_u8(a, b);
+        }
+        static inline uint32_t bits(Vec v)
+        {
+            // no movemask on NEON, weight each lane and add horizontally
+            static const uint8_t weight[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                               1, 2, 4, 8, 16, 32, 64, 128};
+            uint8x16_t m = vandq_u8(v, vld1q_u8(weight));
+            return (uint32_t)vaddv_u8(vget_low_u8(m)) |
+                   ((uint32_t)vaddv_u8(vget_high_u8(m)) << 8);
+        }
+#endif
+        static const uint32_t AllBits = USC_SCAN_WIDTH == 32 ? 0xFFFFFFFFu : 0xFFFFu;
+
+        // Bit i of each mask corresponds to p[i], USC_SCAN_WIDTH bytes are read.
+        static inline uint32_t structuralMask(const char *p)
+        {
+            Vec v = load(p);
+            Vec m = vor(vor(vor(eq(v, '!'), eq(v, '@')), vor(eq(v, '.'), eq(v, ':'))),
+                        vor(vor(eq(v, '/'), eq(v, '?')), vor(eq(v, '='), eq(v, '&'))));
+            m = vor(m, vor(vor(eq(v, '|'), eq(v, '$')), vor(eq(v, '\\'), eq(v, '#'))));
+            return bits(m);
+        }
+        static inline uint32_t keyMask(const char *p)
+        {
+            Vec v = load(p);
+            Vec m = vor(range(v, '0', '9'), range(lower(v), 'a', 'z'));
+            m = vor(m, vor(eq(v, '-'), vor(eq(v, '_'), eq(v, '.'))));
+            return bits(m);
+        }
+        static inline uint32_t digitMask(const char *p)
+        {
+            return bits(range(load(p), '0', '9'));
+        }
+        static inline uint32_t valueEndMask(const char *p)
+        {
+            Vec v = load(p);
+            return bits(vor(vor(eq(v, '&'), eq(v, '|')), vor(eq(v, '$'), eq(v, '\\'))));
+        }
+        static inline uint32_t responseEndMask(const char *p)
+        {
+            Vec v = load(p);
+            return bits(vor(eq(v, '$'), eq(v, '\\')));
+        }
+        static inline uint32_t skipStopMask(const char *p)
+        {
+            Vec v = load(p);
+            Vec m = vor(vor(eq(v, '!'), eq(v, '@')), eq(v, USC_BINARY_START));
+            return bits(vor(m, vor(eq(v, '$'), eq(v, '\\'))));
+        }
+        static inline uint32_t startMask(const char *p)
+        {
+            Vec v = load(p);
+            return bits(vor(vor(eq(v, '!'), eq(v, '@')), eq(v, USC_BINARY_START)));
+        }
+        static inline uint32_t spaceMask(const char *p)
+        {
+            Vec v = load(p);
+            return bits(vor(vor(eq(v, ' '), eq(v, '\r')), vor(eq(v, '\n'), eq(v, '\t'))));
+        }
+
+        static inline int firstBit(uint32_t m)
+        {
+            return __builtin_ctz(m);
+        }
+
+        // Return the first byte in [p, e) for which the mask bit equals `stop`.
+        template <uint32_t (*Mask)(const char *), bool stop>
+        static inline const char *find(const char *p, const char *e, uint8_t cls)
+        {
+            while (e - p >= USC_SCAN_WIDTH)
+            {
+                uint32_t m = Mask(p);
+                if (!stop)
+                {
+                    m = ~m & AllBits;
+                }
+                if (m != 0)
+                {
+                    return p + firstBit(m);
+                }
+                p += USC_SCAN_WIDTH;
+            }
+            while (p != e && is(*p, cls) != stop)
+            {
+                p++;
+            }
+            return p;
+        }
+
+        static inline uint8_t xorBytes(const char *p, size_t n, uint8_t chk)
+        {
+            size_t i = 0;
+#if defined(USC_SCAN_AVX2)
+            if (n >= 32)
+            {
+                __m256i acc = _mm256_setzero_si256();
+                for (; i + 32 <= n; i += 32)
+                {
+                    acc = _mm256_xor_si256(acc, load(p + i));
+                }
+                __m128i x = _mm_xor_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 8));
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 4));
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 2));
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 1));
+                chk ^= (uint8_t)_mm_cvtsi128_si32(x);
+            }
+#elif defined(USC_SCAN_SSE2)
+            if (n >= 16)
+            {
+                __m128i x = _mm_setzero_si128();
+                for (; i + 16 <= n; i += 16)
+                {
+                    x = _mm_xor_si128(x, load(p + i));
+                }
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 8));
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 4));
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 2));
+                x = _mm_xor_si128(x, _mm_srli_si128(x, 1));
+                chk ^= (uint8_t)_mm_cvtsi128_si32(x);
+            }
+#elif defined(USC_SCAN_NEON)
+            if (n >= 16)
+            {
+                uint8x16_t x = vdupq_n_u8(0);
+                for (; i + 16 <= n; i += 16)
+                {
+                    x = veorq_u8(x, load(p + i));
+                }
+                uint8x8_t h = veor_u8(vget_low_u8(x), vget_high_u8(x));
+                uint64_t w = vget_lane_u64(vreinterpret_u64_u8(h), 0);
+                w ^= w >> 32;
+                w ^= w >> 16;
+                w ^= w >> 8;
+                chk ^= (uint8_t)w;
+            }
+#endif
+            for (; i < n; i++)
+            {
+                chk ^= (uint8_t)p[i];
+            }
+            return chk;
+        }
+#else
+        template <bool stop>
+        static inline const char *find(const char *p, const char *e, uint8_t cls)
+        {
+            while (p != e && is(*p, cls) != stop)
+            {
+                p++;
+            }
+            return p;
+        }
+
+        static inline uint8_t xorBytes(const char *p, size_t n, uint8_t chk)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                chk ^= (uint8_t)p[i];
+            }
+            return chk;
+        }
+#endif
+
+#if USC_SCAN_WIDTH > 1
+#define USC_SCAN_FIND(mask, stop, cls) find<mask, stop>(p, e, cls)
+#else
+#define USC_SCAN_FIND(mask, stop, cls) find<stop>(p, e, cls)
+#endif
+        // end of a run of digits
+        static inline const char *skipDigits(const char *p, const char *e)
+        {
+            return USC_SCAN_FIND(digitMask, false, cDigit);
+        }
+        // end of a run of key characters
+        static inline const char *skipKey(const char *p, const char *e)
+        {
+            return USC_SCAN_FIND(keyMask, false, cKey);
+        }
+        // end of a run of white space
+        static inline const char *skipSpace(const char *p, const char *e)
+        {
+            return USC_SCAN_FIND(spaceMask, false, cSpace);
+        }
+        // next `&`, `|`, `$` or backslash
+        static inline const char *findValueEnd(const char *p, const char *e)
+        {
+            return USC_SCAN_FIND(valueEndMask, true, cValueEnd);
+        }
+        // next `!`, `@` or binary start
+        static inline const char *findStart(const char *p, const char *e)
+        {
+            return USC_SCAN_FIND(startMask, true, cStart);
+        }
+        // next structural character
+        static inline const char *findStructural(const char *p, const char *e)
+        {
+            return USC_SCAN_FIND(structuralMask, true, cStructural);
+        }
+        // next `$` or backslash
+        static inline const char *findResponseEnd(const char *p, const char *e)
+        {
+#if USC_SCAN_WIDTH > 1
+            while (e - p >= USC_SCAN_WIDTH)
+            {
+                uint32_t m = responseEndMask(p);
+                if (m != 0)
+                {
+                    return p + firstBit(m);
+                }
+                p += USC_SCAN_WIDTH;
+            }
+#endif
+            while (p != e && *p != '$' && *p != '\\')
+            {
+                p++;
+            }
+            return p;
+        }
+        // next start marker, `$` or backslash
+        static inline const char *findSkipStop(const char *p, const char *e)
+        {
+#if USC_SCAN_WIDTH > 1
+            while (e - p >= USC_SCAN_WIDTH)
+            {
+                uint32_t m = skipStopMask(p);
+                if (m != 0)
+                {
+                    return p + firstBit(m);
+                }
+                p += USC_SCAN_WIDTH;
+            }
+#endif
+            while (p != e && !is(*p, cStart) && *p != '$' && *p != '\\')
+            {
+                p++;
+            }
+            return p;
+        }
+#undef USC_SCAN_FIND
+    };
+};
+
+#endif
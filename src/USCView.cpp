@@ -0,0 +1,523 @@
+#include <string.h>
+#include "USCView.h"
+#include "USCScan.h"
+
+static inline bool isEscape(char c)
+{
+    return usc::scan::is(c, usc::scan::cEscape);
+}
+// digits and separators of `dev[:comp]`
+static inline bool isAddress(char c)
+{
+    return usc::scan::is(c, usc::scan::cDigit) || c == '.' || c == '-' || c == '_' || c == ':';
+}
+static inline char unescape(char c)
+{
+    switch (c)
+    {
+    case 'r':
+        return '\r';
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case 'b':
+        return '\b';
+    }
+    return c;
+}
+
+namespace usc
+{
+    static const Span EmptySpan;
+
+    // same limits as the command parser, errors are reported at the offending digit
+    static Result toNumber(const char *p, const char *q, uint8_t nd, uint32_t max,
+                           uint32_t &v, const char *&end, uint8_t base = 10)
+    {
+        v = 0;
+        for (uint8_t i = 0; p != q; p++)
+        {
+            end = p;
+            if (++i > nd)
+            {
+                return Unexpected;
+            }
+            v = v * base + check::digitOf(*p);
+            if (v > max)
+            {
+                return Overflow;
+            }
+        }
+        return Next;
+    }
+
+    Span::Span(const char *p, size_t n)
+        : ptr(p), len(n)
+    {
+    }
+    bool Span::empty() const
+    {
+        return len == 0;
+    }
+    bool Span::equals(const char *s) const
+    {
+        return strncmp(ptr ? ptr : "", s, len) == 0 && s[len] == 0;
+    }
+
+    FrameView::FrameView()
+    {
+        clear();
+    }
+
+    void FrameView::clear(void)
+    {
+        _device = InvalidDevice;
+        _component = USC_DEFAULT_COMPONENT;
+        _checksum = 0;
+        _hasChecksum = false;
+        _response = false;
+        _id = 0;
+        _hasId = false;
+        _frame = Span();
+        _deviceText = Span();
+        _componentText = Span();
+        _action = Span();
+        _payload = Span();
+        _count = 0;
+    }
+
+    bool FrameView::isBroadcast(void) const
+    {
+        return _device == USC_BROADCAST_ADDR;
+    }
+    bool FrameView::isResponse(void) const
+    {
+        return _response;
+    }
+    bool FrameView::hasChecksum(void) const
+    {
+        return _hasChecksum;
+    }
+    check::Value FrameView::checksum(void) const
+    {
+        return _checksum;
+    }
+    uint32_t FrameView::device(void) const
+    {
+        return _device;
+    }
+    uint16_t FrameView::component(void) const
+    {
+        return _component;
+    }
+    // id of a request, or the id a response echoes after its address
+    bool FrameView::hasId(void) const
+    {
+        return _hasId;
+    }
+    uint16_t FrameView::id(void) const
+    {
+        return _id;
+    }
+    bool FrameView::hasAction(void) const
+    {
+        return _action.len != 0;
+    }
+    const Span &FrameView::frame(void) const
+    {
+        return _frame;
+    }
+    const Span &FrameView::deviceText(void) const
+    {
+        return _deviceText;
+    }
+    const Span &FrameView::componentText(void) const
+    {
+        return _componentText;
+    }
+    const Span &FrameView::action(void) const
+    {
+        return _action;
+    }
+    const Span &FrameView::payload(void) const
+    {
+        return _payload;
+    }
+    int FrameView::count(void) const
+    {
+        return _count;
+    }
+    const Span &FrameView::key(int i) const
+    {
+        return (i >= 0 && i < _count) ? _params[i].key : EmptySpan;
+    }
+    const Span &FrameView::value(int i) const
+    {
+        return (i >= 0 && i < _count) ? _params[i].value : EmptySpan;
+    }
+    bool FrameView::hasValue(int i) const
+    {
+        return i >= 0 && i < _count && _params[i].hasValue;
+    }
+    bool FrameView::isEscaped(int i) const
+    {
+        return i >= 0 && i < _count && _params[i].escaped;
+    }
+
+    size_t FrameView::copyValue(int i, char *dest, size_t n) const
+    {
+        if (n == 0)
+        {
+            return 0;
+        }
+        const Span &v = value(i);
+        size_t nd = 0;
+        if (!isEscaped(i))
+        {
+            nd = v.len < n - 1 ? v.len : n - 1;
+            memcpy(dest, v.ptr, nd);
+        }
+        else
+        {
+            for (size_t k = 0; k < v.len && nd < n - 1; k++)
+            {
+                char c = v.ptr[k];
+                if (c == '\\')
+                {
+                    c = unescape(v.ptr[++k]);
+                }
+                dest[nd++] = c;
+            }
+        }
+        dest[nd] = 0;
+
+        return nd;
+    }
+
+    Result FrameView::parse(const char *buf, size_t n, size_t &used)
+    {
+        clear();
+
+        const char *e = buf + n;
+        const char *p = scan::skipSpace(buf, e);
+        used = p - buf;
+        if (p == e)
+        {
+            return Next;
+        }
+
+        const char *end = p;
+        Result res;
+        switch (*p)
+        {
+        case '!':
+            res = parseCommand(p, e, end);
+            break;
+        case '@':
+            res = parseResponse(p, e, end);
+            break;
+        default:
+            res = Unexpected;
+            break;
+        }
+
+        if (res == Next)
+        {
+            clear();
+            return Next;
+        }
+        if (res == OK)
+        {
+            _frame = Span(p, end + 1 - p);
+        }
+        used = end + 1 - buf;
+
+        return res;
+    }
+
+    Result FrameView::parseResponse(const char *p, const char *e, const char *&end)
+    {
+        // same rules as the command parser: payload ends on unescaped `$`
+        const char *b = ++p;
+        bool escape = false;
+        while (p != e)
+        {
+            if (escape)
+            {
+                if (!isEscape(*p))
+                {
+                    end = p;
+                    return Unexpected;
+                }
+                escape = *p == '\\';
+                p++;
+                continue;
+            }
+            p = scan::findResponseEnd(p, e);
+            if (p == e)
+            {
+                break;
+            }
+            if (*p == '$')
+            {
+                _response = true;
+                _payload = Span(b, p - b);
+                end = p;
+
+                // `dev[:comp]#id` in front of the payload
+                const char *q = b;
+                while (q != p && isAddress(*q))
+                {
+                    q++;
+                }
+                if (q != p && *q == '#')
+                {
+                    const char *r = scan::skipDigits(++q, p);
+                    uint32_t v;
+                    const char *at;
+                    _hasId = r != q && toNumber(q, r, 5, UINT16_MAX, v, at) == Next;
+                    _id = _hasId ? (uint16_t)v : 0;
+                }
+                return OK;
+            }
+            escape = true;
+            p++;
+        }
+        return Next;
+    }
+
+    Result FrameView::parseCommand(const char *p, const char *e, const char *&end)
+    {
+        const char *b = p++;
+        const char *q;
+
+        // device address, up to 4 segments of 3 digits
+        uint8_t ns = 0;
+        _device = 0;
+        _deviceText.ptr = p;
+        for (;;)
+        {
+            q = scan::skipDigits(p, e);
+            uint32_t v;
+            Result res = toNumber(p, q, 3, UINT8_MAX, v, end);
+            if (res != Next)
+            {
+                return res;
+            }
+            if (q == e)
+            {
+                return Next;
+            }
+            end = q;
+            switch (*q)
+            {
+            case '-':
+            case '_':
+            case '.':
+            case ':':
+            case '#':
+            case '/':
+            case '|':
+            case '$':
+                break;
+            default:
+                return Unexpected;
+            }
+            if (++ns > 4)
+            {
+                return Unexpected;
+            }
+            _device <<= 4;
+            _device |= v;
+
+            p = q + 1;
+            if (*q != '-' && *q != '_' && *q != '.')
+            {
+                break;
+            }
+        }
+        _deviceText.len = q - _deviceText.ptr;
+
+        // component
+        if (*q == ':')
+        {
+            q = scan::skipDigits(p, e);
+            uint32_t v;
+            Result res = toNumber(p, q, 5, UINT16_MAX, v, end);
+            if (res != Next)
+            {
+                return res;
+            }
+            if (q == e)
+            {
+                return Next;
+            }
+            end = q;
+            if (*q != '#' && *q != '/' && *q != '|' && *q != '$')
+            {
+                return Unexpected;
+            }
+            _componentText = Span(p, q - p);
+            _component = (uint16_t)v;
+            p = q + 1;
+        }
+
+        // request id
+        if (*q == '#')
+        {
+            q = scan::skipDigits(p, e);
+            uint32_t v;
+            Result res = toNumber(p, q, 5, UINT16_MAX, v, end);
+            if (res != Next)
+            {
+                return res;
+            }
+            if (q == e)
+            {
+                return Next;
+            }
+            end = q;
+            if (*q != '/' && *q != '|' && *q != '$')
+            {
+                return Unexpected;
+            }
+            _id = (uint16_t)v;
+            _hasId = true;
+            p = q + 1;
+        }
+
+        // action, `/` separated keys
+        if (*q == '/')
+        {
+            _action.ptr = p;
+            for (;;)
+            {
+                q = scan::skipKey(p, e);
+                if (q == e)
+                {
+                    return Next;
+                }
+                end = q;
+                if (*q != '/')
+                {
+                    break;
+                }
+                if (q[-1] == '/')
+                {
+                    return Unexpected;
+                }
+                p = q + 1;
+            }
+            if (*q != '?' && *q != '|' && *q != '$')
+            {
+                return Unexpected;
+            }
+            _action.len = q - _action.ptr;
+            p = q + 1;
+        }
+
+        // params, a key without value may only be the last one
+        if (*q == '?')
+        {
+            for (;;)
+            {
+                if (_count >= USC_MAXPARAMS)
+                {
+                    end = p;
+                    return Overflow;
+                }
+                Param &par = _params[_count++];
+                par.hasValue = false;
+                par.escaped = false;
+
+                q = scan::skipKey(p, e);
+                if (q == e)
+                {
+                    return Next;
+                }
+                end = q;
+                par.key = Span(p, q - p);
+                par.value = Span();
+                if (*q != '=')
+                {
+                    break;
+                }
+
+                p = q + 1;
+                const char *v = p;
+                for (;;)
+                {
+                    q = scan::findValueEnd(p, e);
+                    if (q == e || (*q == '\\' && q + 1 == e))
+                    {
+                        return Next;
+                    }
+                    if (*q != '\\')
+                    {
+                        break;
+                    }
+                    if (!isEscape(q[1]))
+                    {
+                        end = q + 1;
+                        return Invalid;
+                    }
+                    par.escaped = true;
+                    p = q + 2;
+                }
+                end = q;
+                par.hasValue = true;
+                par.value = Span(v, q - v);
+                if (*q != '&')
+                {
+                    break;
+                }
+                p = q + 1;
+            }
+            if (*q != '|' && *q != '$')
+            {
+                return Unexpected;
+            }
+            p = q + 1;
+        }
+
+        // checksum over every byte from `!` up to and including `|`
+        if (*q == '|')
+        {
+            check::Value chk = check::update(check::Init, b, q + 1 - b);
+            q = p;
+            while (q != e && check::isDigit(*q))
+            {
+                q++;
+            }
+            uint32_t v;
+            Result res = toNumber(p, q, check::Digits, check::Max, v, end, check::Hex ? 16 : 10);
+            if (res != Next)
+            {
+                return res;
+            }
+            if (q == e)
+            {
+                return Next;
+            }
+            end = q;
+            if (*q != '$' || (check::Hex && q - p != check::Digits))
+            {
+                return Unexpected;
+            }
+            _checksum = chk;
+            _hasChecksum = true;
+            if (v != chk)
+            {
+                return Invalid;
+            }
+        }
+        else
+        {
+            _checksum = check::update(check::Init, b, q + 1 - b);
+        }
+
+        end = q;
+        return OK;
+    }
+};
@@ -0,0 +1,78 @@
+#ifndef _USCVIEW_H_
+#define _USCVIEW_H_
+
+#include "USCommand.h"
+
+namespace usc
+{
+    // Pointer and length into a caller owned buffer, not NUL terminated.
+    struct Span
+    {
+        const char *ptr;
+        size_t len;
+
+        Span(const char *p = nullptr, size_t n = 0);
+
+        bool empty() const;
+        bool equals(const char *s) const;
+    };
+
+    // Parses a complete frame in place without copying or modifying it.
+    class FrameView
+    {
+    public:
+        FrameView();
+
+        Result parse(const char *buf, size_t n, size_t &used);
+        void clear(void);
+        bool isBroadcast(void) const;
+        bool isResponse(void) const;
+        bool hasChecksum(void) const;
+        check::Value checksum(void) const;
+        uint32_t device(void) const;
+        uint16_t component(void) const;
+        bool hasId(void) const;
+        uint16_t id(void) const;
+        bool hasAction(void) const;
+        const Span &frame(void) const;
+        const Span &deviceText(void) const;
+        const Span &componentText(void) const;
+        const Span &action(void) const;
+        const Span &payload(void) const;
+        int count(void) const;
+        const Span &key(int i) const;
+        const Span &value(int i) const;
+        bool hasValue(int i) const;
+        bool isEscaped(int i) const;
+        size_t copyValue(int i, char *dest, size_t n) const;
+
+    private:
+        struct Param
+        {
+            Span key;
+            Span value;
+            bool hasValue;
+            bool escaped;
+        };
+
+        uint32_t _device;
+        uint16_t _component;
+        uint16_t _id;
+        check::Value _checksum;
+        bool _hasChecksum;
+        bool _hasId;
+        bool _response;
+        Span _frame;
+        Span _deviceText;
+        Span _componentText;
+        Span _action;
+        Span _payload;
+        int _count;
+        Param _params[USC_MAXPARAMS];
+
+        Result parseResponse(const char *p, const char *e, const char *&end);
+        Result parseCommand(const char *p, const char *e, const char *&end);
+    };
+};
+
+#endif
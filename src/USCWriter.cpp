@@ -0,0 +1,469 @@
+#include <limits.h>
+#include <string.h>
+#include "USCWriter.h"
+#include "USCScan.h"
+#include "USCommand.h"
+
+// last part written to the current frame
+enum
+{
+    pNone,
+    pStart,
+    pDevice,
+    pComponent,
+    pId,
+    pAction,
+    pParam
+};
+
+// character written after the backslash, 0 if c is written as is
+static inline char escapeOf(char c)
+{
+    switch (c)
+    {
+    case '\r':
+        return 'r';
+    case '\n':
+        return 'n';
+    case '\t':
+        return 't';
+    case '\b':
+        return 'b';
+    case '\\':
+    case '&':
+    case '$':
+    case '=':
+    case '|':
+        return c;
+    }
+    return 0;
+}
+
+namespace usc
+{
+    FrameEncoder::FrameEncoder(char *buf, size_t size)
+        : _buf(buf), _size(size)
+    {
+        clear();
+    }
+    CommandEncoder::CommandEncoder(char *buf, size_t size)
+        : FrameEncoder(buf, size)
+    {
+    }
+    ResponseWriter::ResponseWriter(char *buf, size_t size)
+        : FrameEncoder(buf, size)
+    {
+    }
+
+    void FrameEncoder::clear(void)
+    {
+        _len = 0;
+        _start = 0;
+        _frames = 0;
+        _chk = check::Init;
+        _sum = 0;
+        _mark = 0;
+        _part = pNone;
+        _binary = false;
+        _overflow = false;
+        if (_size > 0)
+        {
+            _buf[0] = 0;
+        }
+    }
+
+    const char *FrameEncoder::data(void) const
+    {
+        return _buf;
+    }
+    size_t FrameEncoder::length(void) const
+    {
+        return _len;
+    }
+    size_t FrameEncoder::frames(void) const
+    {
+        return _frames;
+    }
+    bool FrameEncoder::overflow(void) const
+    {
+        return _overflow;
+    }
+    // checksum of the last frame, the value written after `|`
+    check::Value FrameEncoder::checksum(void) const
+    {
+        return _sum;
+    }
+
+    void FrameEncoder::put(char c)
+    {
+        // keep one byte for the terminating 0
+        if (_len + 1 < _size)
+        {
+            _buf[_len++] = c;
+            _chk = check::step(_chk, c);
+        }
+        else
+        {
+            _overflow = true;
+        }
+    }
+    void FrameEncoder::putEscaped(char c)
+    {
+        char ec = _binary ? 0 : escapeOf(c);
+        if (ec != 0)
+        {
+            put('\\');
+            c = ec;
+        }
+        put(c);
+    }
+    void FrameEncoder::putString(const char *s)
+    {
+        size_t n = strlen(s);
+        if (_len + n < _size)
+        {
+            memcpy(_buf + _len, s, n);
+            _chk = check::update(_chk, s, n);
+            _len += n;
+        }
+        else
+        {
+            _overflow = true;
+        }
+    }
+    void FrameEncoder::putNumber(unsigned long v)
+    {
+        // 3 digits per byte hold every unsigned long
+        char digits[3 * sizeof(unsigned long)];
+        uint8_t n = 0;
+        do
+        {
+            digits[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        while (n > 0)
+        {
+            put(digits[--n]);
+        }
+    }
+
+    void FrameEncoder::open(char start)
+    {
+        _start = _len;
+        _chk = check::Init;
+        _mark = 0;
+        _part = pStart;
+        _overflow = false;
+        _binary = start == USC_BINARY_START;
+        put(start);
+        if (_binary)
+        {
+            // length and flags, set while the frame is written
+            put(0);
+            put((char)BinaryMarker);
+        }
+    }
+
+    // length prefixed field of a binary frame, its length is set by closeField()
+    void FrameEncoder::openField(void)
+    {
+        closeField();
+        put(0);
+        _mark = _len;
+    }
+    void FrameEncoder::closeField(void)
+    {
+        if (_mark == 0)
+        {
+            return;
+        }
+        size_t n = _len - _mark;
+        if (n >= BinaryNoValue)
+        {
+            _overflow = true;
+        }
+        else
+        {
+            _buf[_mark - 1] = (char)n;
+        }
+        _mark = 0;
+    }
+    void FrameEncoder::setFlag(uint8_t bits)
+    {
+        if (_start + 2 < _len)
+        {
+            _buf[_start + 2] |= bits;
+        }
+    }
+
+    FrameEncoder &CommandEncoder::begin(void)
+    {
+        open('!');
+        return *this;
+    }
+    FrameEncoder &CommandEncoder::beginBinary(void)
+    {
+        open(USC_BINARY_START);
+        return *this;
+    }
+    FrameEncoder &ResponseWriter::begin(void)
+    {
+        open('@');
+        return *this;
+    }
+
+    FrameEncoder &FrameEncoder::device(uint8_t segment)
+    {
+        if (_binary)
+        {
+            // the segment count is in the low bits of flags
+            put((char)segment);
+            if (_start + 2 < _len)
+            {
+                _buf[_start + 2]++;
+            }
+            _part = pDevice;
+            return *this;
+        }
+        if (_part == pDevice)
+        {
+            put('.');
+        }
+        putNumber(segment);
+        _part = pDevice;
+        return *this;
+    }
+
+    FrameEncoder &FrameEncoder::address(const uint8_t *segments, uint8_t n)
+    {
+        for (uint8_t i = 0; i < n; i++)
+        {
+            device(segments[i]);
+        }
+        return *this;
+    }
+
+    FrameEncoder &FrameEncoder::component(uint16_t comp)
+    {
+        if (_binary)
+        {
+            setFlag(BinaryComponent);
+            put((char)(comp & 0xFF));
+            put((char)(comp >> 8));
+            _part = pComponent;
+            return *this;
+        }
+        put(':');
+        putNumber(comp);
+        _part = pComponent;
+        return *this;
+    }
+
+    // request id, a response echoes the id of its request
+    FrameEncoder &FrameEncoder::id(uint16_t id)
+    {
+        if (_binary)
+        {
+            setFlag(BinaryId);
+            put((char)(id & 0xFF));
+            put((char)(id >> 8));
+            _part = pId;
+            return *this;
+        }
+        put('#');
+        putNumber(id);
+        _part = pId;
+        return *this;
+    }
+
+    FrameEncoder &FrameEncoder::action(const char *action)
+    {
+        if (!_binary || _part == pAction)
+        {
+            put('/');
+        }
+        else
+        {
+            openField();
+        }
+        putString(action);
+        _part = pAction;
+        return *this;
+    }
+
+    FrameEncoder &FrameEncoder::param(const char *key)
+    {
+        if (!_binary)
+        {
+            put(_part == pParam ? '&' : '?');
+            putString(key);
+            _part = pParam;
+            return *this;
+        }
+
+        // empty action in front of the first param
+        closeField();
+        if (_part != pAction && _part != pParam)
+        {
+            put(0);
+        }
+        openField();
+        putString(key);
+        closeField();
+        put((char)BinaryNoValue);
+        _part = pParam;
+        return *this;
+    }
+    // `=` of a text frame, in a binary frame the length of the value replaces no value
+    void FrameEncoder::beginValue(void)
+    {
+        if (!_binary)
+        {
+            put('=');
+        }
+        else if (!_overflow)
+        {
+            _mark = _len;
+        }
+    }
+    FrameEncoder &FrameEncoder::param(const char *key, const char *value)
+    {
+        param(key);
+        beginValue();
+        while (*value != 0)
+        {
+            putEscaped(*value++);
+        }
+        return *this;
+    }
+    FrameEncoder &FrameEncoder::param(const char *key, int value)
+    {
+        return param(key, (long)value);
+    }
+    FrameEncoder &FrameEncoder::param(const char *key, unsigned long value)
+    {
+        param(key);
+        beginValue();
+        putNumber(value);
+        return *this;
+    }
+    FrameEncoder &FrameEncoder::param(const char *key, double value, uint8_t decimals)
+    {
+        param(key);
+        beginValue();
+        if (value < 0)
+        {
+            put('-');
+            value = -value;
+        }
+
+        // round at the last decimal, then write integer and fraction part
+        double scale = 1;
+        for (uint8_t i = 0; i < decimals; i++)
+        {
+            scale *= 10;
+        }
+        value += 0.5 / scale;
+
+        // NaN, infinities and values beyond unsigned long have no digits, the frame is dropped
+        if (!(value < (double)ULONG_MAX))
+        {
+            _overflow = true;
+            return *this;
+        }
+        unsigned long ip = (unsigned long)value;
+        putNumber(ip);
+        if (decimals > 0)
+        {
+            put('.');
+            double frac = value - ip;
+            for (uint8_t i = 0; i < decimals; i++)
+            {
+                frac *= 10;
+                uint8_t d = (uint8_t)frac;
+                put('0' + d);
+                frac -= d;
+            }
+        }
+        return *this;
+    }
+    FrameEncoder &FrameEncoder::param(const char *key, long value)
+    {
+        param(key);
+        beginValue();
+        if (value < 0)
+        {
+            put('-');
+            putNumber(0UL - (unsigned long)value);
+        }
+        else
+        {
+            putNumber((unsigned long)value);
+        }
+        return *this;
+    }
+
+    // free text after the header, escaped like a param value
+    FrameEncoder &FrameEncoder::text(const char *s)
+    {
+        while (*s != 0)
+        {
+            putEscaped(*s++);
+        }
+        return *this;
+    }
+
+    size_t FrameEncoder::end(bool checksum)
+    {
+        if (_binary)
+        {
+            // always checked, written little endian
+            closeField();
+            size_t n = _len - _start - 2;
+            if (n > 255)
+            {
+                _overflow = true;
+            }
+            else if (!_overflow)
+            {
+                _buf[_start + 1] = (char)n;
+            }
+            _sum = check::update(check::Init, _buf + _start, _len - _start);
+            for (uint8_t i = 0; i < sizeof(check::Value); i++)
+            {
+                put((char)(_sum >> (8 * i)));
+            }
+        }
+        else if (checksum)
+        {
+            put('|');
+            _sum = _chk;
+            char digits[check::Digits];
+            uint8_t n = check::format(_sum, digits);
+            for (uint8_t i = 0; i < n; i++)
+            {
+                put(digits[i]);
+            }
+        }
+        if (!_binary)
+        {
+            put('$');
+        }
+        _part = pNone;
+
+        // drop an incomplete frame, the frames before it can still be sent
+        if (_overflow)
+        {
+            _len = _start;
+        }
+        else
+        {
+            _frames++;
+        }
+        if (_size > 0)
+        {
+            _buf[_len] = 0;
+        }
+        return _len - _start;
+    }
+};
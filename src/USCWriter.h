@@ -0,0 +1,90 @@
+#ifndef _USCWRITER_H_
+#define _USCWRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "USCChecksum.h"
+
+namespace usc
+{
+    // Writes frames into a caller provided buffer in one pass:
+    //   start dev[.dev][:comp][#id][/action/action][?key=value&key][|chk]$
+    // The checksum is updated while bytes are appended, param values are escaped.
+    // Several frames can be written back to back and sent with one write().
+    // Binary frames (see BinaryFrame in USCommand.h) take the same calls, action
+    // segments, keys and values are at most 254 bytes and never escaped.
+    // A frame that does not fit, or holds a number without digits (NaN, infinite or
+    // beyond unsigned long), is dropped by end() and sets overflow() until the next
+    // begin(); the frames before it stay in the buffer.
+    class FrameEncoder
+    {
+    public:
+        FrameEncoder &device(uint8_t segment);
+        FrameEncoder &address(const uint8_t *segments, uint8_t n);
+        FrameEncoder &component(uint16_t comp);
+        FrameEncoder &id(uint16_t id);
+        FrameEncoder &action(const char *action);
+        FrameEncoder &param(const char *key);
+        FrameEncoder &param(const char *key, const char *value);
+        FrameEncoder &param(const char *key, int value);
+        FrameEncoder &param(const char *key, long value);
+        FrameEncoder &param(const char *key, unsigned long value);
+        FrameEncoder &param(const char *key, double value, uint8_t decimals = 2);
+        FrameEncoder &text(const char *s);
+        size_t end(bool checksum = true);
+
+        void clear(void);
+        const char *data(void) const;
+        size_t length(void) const;
+        size_t frames(void) const;
+        bool overflow(void) const;
+        check::Value checksum(void) const;
+
+    protected:
+        FrameEncoder(char *buf, size_t size);
+
+        void open(char start);
+        void openField(void);
+        void closeField(void);
+        void setFlag(uint8_t bits);
+        void beginValue(void);
+        void put(char c);
+        void putEscaped(char c);
+        void putString(const char *s);
+        void putNumber(unsigned long v);
+
+    private:
+        char *_buf;
+        size_t _size;
+        size_t _len;
+        size_t _start;
+        size_t _frames;
+        check::Value _chk;
+        check::Value _sum;
+        size_t _mark;
+        uint8_t _part;
+        bool _binary;
+        bool _overflow;
+    };
+
+    // Commands sent by a host: `!...$`, or binary frames
+    class CommandEncoder : public FrameEncoder
+    {
+    public:
+        CommandEncoder(char *buf, size_t size);
+
+        FrameEncoder &begin(void);
+        FrameEncoder &beginBinary(void);
+    };
+
+    // Responses sent by a device: `@...$`
+    class ResponseWriter : public FrameEncoder
+    {
+    public:
+        ResponseWriter(char *buf, size_t size);
+
+        FrameEncoder &begin(void);
+    };
+};
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef _USCOMMAND_H_
 #define _USCOMMAND_H_
 
+#include <stddef.h>
 #include <stdint.h>
+#include "USCChecksum.h"
 
 #define USC_BROADCAST_ADDR 0
 #define USC_DEFAULT_COMPONENT 0
@@ -10,13 +12,47 @@
 #define USC_BUFSIZE 128
 #endif
 
+// maximum number of params of a single command
+#ifndef USC_MAXPARAMS
+#define USC_MAXPARAMS 8
+#endif
+
+// maximum number of action segments split by `/`, the last one keeps the rest
+#ifndef USC_MAXSEGMENTS
+#define USC_MAXSEGMENTS 4
+#endif
+
+// 1: drive the parser from a transition table instead of the per state functions
+#ifndef USC_TABLE_ENGINE
+#define USC_TABLE_ENGINE 0
+#endif
+
+// 1: accept binary frames (see BinaryFrame) in usc::Command, off as a stray STX would
+// hold up the text frames behind it until the header is checked
+#ifndef USC_BINARY
+#define USC_BINARY 0
+#endif
+
+// 1: count frames, errors, bytes and time per parser state, see Stats
+#ifndef USC_STATS
+#define USC_STATS 0
+#endif
+
+// parser states counted by Stats, and the width of a frame length bucket
+#define USC_STATES 12
+#define USC_STATS_BUCKET 16
+
+#define USC_HASH_BASIS 2166136261UL
+#define USC_HASH_PRIME 16777619UL
+
 namespace usc
 {
     enum Identifier
     {
         Broadcast = 0x00,
         InvalidDevice = UINT32_MAX,
-        InvalidComponent = UINT16_MAX
+        InvalidComponent = UINT16_MAX,
+        UnknownSegment = UINT8_MAX
     };
 
     enum Result
@@ -28,16 +64,185 @@ namespace usc
         Overflow
     };
 
-    class Command;
-    class Params;
+    // Binary frame, selected by the start byte USC_BINARY_START:
+    //   STX len flags seg[n] [comp:2] [id:2] [alen action {klen key vlen value}] crc
+    // len counts the bytes from flags up to the last value, numbers are little endian and
+    // crc is the checksum of all bytes before it (1 or 2 bytes, see USCChecksum.h).
+    // flags holds the segment count n, whether component and id follow and the marker
+    // bit, which no text byte has.
+    enum BinaryFrame
+    {
+        BinarySegments = 0x0F,
+        BinaryComponent = 0x10,
+        BinaryId = 0x20,
+        BinaryMarker = 0x80,
+        BinaryNoValue = 0xFF
+    };
+
+    template <typename Cfg>
+    class BasicCommand;
+    template <typename Cfg>
+    class BasicParams;
+    class Dispatcher;
+    class Vocabulary;
+
+    template <bool Small>
+    struct OffsetType
+    {
+        typedef uint8_t Type;
+    };
+    template <>
+    struct OffsetType<false>
+    {
+        typedef uint16_t Type;
+    };
+
+    // Parts of a BasicCommand around the parser, the Features of a CommandConfig. A part
+    // which is left out takes no RAM, its getters return the values of an empty frame
+    // and its setters do not compile.
+    enum Feature
+    {
+        FeatureCallbacks = 0x01, // attachCallback(), otherwise results come from process()
+        FeatureAddress = 0x02,   // own address and setAddressFilter(), otherwise every frame matches
+        FeatureIds = 0x04,       // id() of `#id`, otherwise the id is checked and dropped
+        FeatureRouting = 0x08,   // action segments, vocabulary and dispatcher, hash kept while parsing
+        FeatureCache = 0x10,     // numbers of param values kept after the first conversion
+        FeatureAll = 0x1F
+    };
+
+    // Capacity and features of a BasicCommand. A disabled feature is rejected like any
+    // other unexpected character and its code is left out of the parser:
+    //   Checksum  - `|chk` in front of the end marker
+    //   Escape    - backslash escapes, otherwise a backslash is a plain character
+    //   Responses - `@...$` frames
+    //   Segments  - segments of the device address, 1 for single number addresses
+    //   Binary    - frames starting with USC_BINARY_START, see BinaryFrame
+    //   Features  - Feature bits of the parts around the parser
+    template <uint16_t BufSize, uint8_t MaxParams, bool Checksum = true, bool Escape = true,
+              bool Responses = true, uint8_t Segments = 4, bool Binary = false, uint8_t Features = FeatureAll>
+    struct CommandConfig
+    {
+        static const uint16_t bufSize = BufSize;
+        static const uint8_t maxParams = MaxParams;
+        static const bool checksum = Checksum;
+        static const bool escape = Escape;
+        static const bool responses = Responses;
+        static const uint8_t segments = Segments;
+        static const bool binary = Binary;
+        static const bool callbacks = (Features & FeatureCallbacks) != 0;
+        static const bool address = (Features & FeatureAddress) != 0;
+        static const bool ids = (Features & FeatureIds) != 0;
+        static const bool routing = (Features & FeatureRouting) != 0;
+        static const bool cache = (Features & FeatureCache) != 0;
+        typedef typename OffsetType<(BufSize < 255)>::Type Offset;
+    };
+
+    typedef CommandConfig<USC_BUFSIZE, USC_MAXPARAMS, true, true, true, 4, USC_BINARY != 0> DefaultConfig;
+    typedef BasicCommand<DefaultConfig> Command;
+    typedef BasicParams<DefaultConfig> Params;
+    typedef DefaultConfig::Offset Offset;
 
     // callback type
     typedef void (*CommandCb)(bool, uint16_t, const char *, Params &);
     typedef void (*ErrorCb)(Result, Command &);
 
+    // FNV-1a, computed by the parser while the action is received
+    constexpr uint32_t hashStep(uint32_t h, char c)
+    {
+        return (h ^ (uint8_t)c) * USC_HASH_PRIME;
+    }
+    constexpr uint32_t hash(const char *s, uint32_t h = USC_HASH_BASIS)
+    {
+        return *s ? hash(s + 1, hashStep(h, *s)) : h;
+    }
+
+    // number of a param value, converted on first access. Longs beyond 32 bits are not kept.
+    struct ParamCache
+    {
+        union
+        {
+            int32_t l;
+            float f;
+        } num;
+        uint8_t cached;
+    };
+
+    // offsets of a param in the command buffer, value 0 means no value
+    template <typename O, bool Cache = true>
+    struct BasicParamEntry
+    {
+        O key;
+        O klen;
+        O value;
+        O vlen;
+
+        mutable ParamCache cache;
+
+        void uncache()
+        {
+            cache.cached = 0;
+        }
+    };
+    // without FeatureCache every valueLong() parses the value again
+    template <typename O>
+    struct BasicParamEntry<O, false>
+    {
+        O key;
+        O klen;
+        O value;
+        O vlen;
+
+        void uncache()
+        {
+        }
+    };
+    typedef BasicParamEntry<Offset> ParamEntry;
+
+#if USC_STATS
+    // Counters of a parser. bytes and cycles are indexed by the state a byte was
+    // received in: begin, response, error, device, component, id, action, key,
+    // value, checksum, skip and binary. cycles are USC_STATS_CLOCK() ticks, lengths counts the commands
+    // by buffer length in buckets of USC_STATS_BUCKET bytes, up to the BufSize of the parser.
+    template <uint16_t BufSize>
+    struct BasicStats
+    {
+        enum
+        {
+            Buckets = BufSize / USC_STATS_BUCKET + 1
+        };
+
+
+        uint32_t frames;
+        uint32_t responses;
+        uint32_t errors[Overflow + 1];
+        uint32_t checksums;
+        uint32_t discarded;
+        uint32_t skipped;
+        uint32_t bytes[USC_STATES];
+        uint32_t cycles[USC_STATES];
+        uint32_t lengths[Buckets];
+    };
+
+    typedef BasicStats<USC_BUFSIZE> Stats;
+
+    template <uint16_t BufSize>
+    void addStats(BasicStats<BufSize> &total, const BasicStats<BufSize> &s)
+    {
+        // every field is a uint32_t counter
+        uint32_t *t = (uint32_t *)&total;
+        const uint32_t *v = (const uint32_t *)&s;
+        for (size_t i = 0; i < sizeof(s) / sizeof(uint32_t); i++)
+        {
+            t[i] += v[i];
+        }
+    }
+#endif
+
     class KeyVal
     {
-        friend class Params;
+        template <typename Cfg>
+        friend class BasicParams;
+        friend class Frame;
 
     public:
         KeyVal(const char *k = nullptr, const char *v = nullptr);
@@ -46,8 +251,10 @@ namespace usc
 
         const char *key() const;
         const char keyChar() const;
+        int keyLength() const;
         const char *value() const;
         const char *safeValue() const;
+        int valueLength() const;
         bool hasValue() const;
         int valueInt(int def = 0) const;
         long valueLong(long def = 0) const;
@@ -64,94 +271,468 @@ namespace usc
     private:
         const char *_key;
         const char *_value;
+        uint16_t _klen;
+        uint16_t _vlen;
+        ParamCache *_cache;
 
+        // a param of a parsed buffer
+        template <typename O>
+        KeyVal(const char *data, const BasicParamEntry<O> &en)
+            : _key(data + en.key), _value(nullptr), _klen(en.klen), _vlen(0), _cache(nullptr)
+        {
+            if (en.value != 0)
+            {
+                _value = data + en.value;
+                _vlen = en.vlen;
+                _cache = &en.cache;
+            }
+        }
+        template <typename O>
+        KeyVal(const char *data, const BasicParamEntry<O, false> &en)
+            : _key(data + en.key), _value(en.value != 0 ? data + en.value : nullptr), _klen(en.klen),
+              _vlen(en.value != 0 ? en.vlen : 0), _cache(nullptr)
+        {
+        }
         void clear();
+        long toLong(int base) const;
+        float toFloat() const;
+    };
+
+    // Schema args of BasicParams, only routing binds them. Like the parts of BasicCommand
+    // below, the base is empty without it.
+    template <typename Cfg, bool On = Cfg::routing>
+    struct ArgsPart
+    {
+        const void *_args;
+    };
+    template <typename Cfg>
+    struct ArgsPart<Cfg, false>
+    {
+        static const void *_args;
     };
 
-    class Params
+    template <typename Cfg>
+    class BasicParams : ArgsPart<Cfg>
     {
-        friend class Command;
+        template <typename C>
+        friend class BasicCommand;
+        friend class CommandPool;
+        friend class Packet;
+        friend class Frame;
+        friend class Dispatcher;
 
     public:
-        Params();
+        BasicParams();
 
-        Params &begin();
+        BasicParams &begin();
         bool next();
         const KeyVal &kv() const;
         int count() const;
         bool empty() const;
+        KeyVal operator[](int i) const;
+        KeyVal find(const char *key) const;
+
+        // params bound by the Schema of the dispatched route, see USCDispatch.h
+        template <typename T>
+        const T &args() const
+        {
+            static_assert(Cfg::routing, "the config has no routing (FeatureRouting)");
+            return *static_cast<const T *>(_args);
+        }
 
     private:
-        char *_beg;
-        char *_end;
-        char *_next;
-        int _count;
-        char *_pkey;
-        char *_pval;
+        typedef BasicParamEntry<typename Cfg::Offset, Cfg::cache> ParamEntry;
+        using ArgsPart<Cfg>::_args;
+
+        const char *_data;
+        ParamEntry _index[Cfg::maxParams];
+        uint8_t _count;
+        uint8_t _next;
         KeyVal _kv;
 
         void clear();
-        void begin(char *beg);
-        void add(char *end = nullptr);
+        void begin(const char *data, int key);
+        bool nextKey(int key);
+        void addKey(int end);
+        void addValue(int end);
+        void endValue(int end);
+    };
+
+    // Parser states, character tokens and the tables shared by all BasicCommand types
+    class CommandBase
+    {
+    public:
+        static bool isOpen(uint8_t state);
+
+    protected:
+        enum
+        {
+            sBegin,
+            sEnd,
+            sError,
+            sDevice,
+            sComponent,
+            sId,
+            sAction,
+            sParamKey,
+            sParamValue,
+            sChecksum,
+            sSkip,
+            sBinary,
+
+            // extra row used by sEnd while the previous char is a backslash
+            rEndEscape,
+            rCount
+        };
+        static_assert(sBinary + 1 == USC_STATES, "USC_STATES must match the parser states");
+
+        // Character tokens used by the table driven engine
+        enum
+        {
+            kOther,
+            kDigit,
+            kAlpha,
+            kDash,
+            kDot,
+            kColon,
+            kSlash,
+            kQuestion,
+            kEqual,
+            kAmp,
+            kPipe,
+            kDollar,
+            kBackslash,
+            kBang,
+            kAt,
+            kSpace,
+            kHash,
+            kCount
+        };
+
+        // Actions of the table driven engine, each action knows its next state
+        enum
+        {
+            aNext,
+            aFail,
+            aBeginCommand,
+            aBeginResponse,
+            aEndEscape,
+            aEndDone,
+            aDigit,
+            aDevSeparator,
+            aDevComponent,
+            aDevAction,
+            aDevChecksum,
+            aDevDone,
+            aDevId,
+            aCompAction,
+            aCompChecksum,
+            aCompDone,
+            aCompId,
+            aIdAction,
+            aIdChecksum,
+            aIdDone,
+            aActChar,
+            aActSlash,
+            aActParams,
+            aActChecksum,
+            aActDone,
+            aKeyValue,
+            aKeyChecksum,
+            aKeyDone,
+            aValKey,
+            aValChecksum,
+            aValDone,
+            aChkDone
+        };
+
+        // Fields of a binary frame in wire order, the phase of sBinary
+        enum
+        {
+            bLength,
+            bFlags,
+            bAddress,
+            bComponent,
+            bId,
+            bActionLength,
+            bAction,
+            bKeyLength,
+            bKey,
+            bValueLength,
+            bValue,
+            bChecksum,
+            bSkip,
+            bDiscard
+        };
+
+        // Part of a text frame passed over in sSkip, kept in _nd
+        enum
+        {
+            pHeader,
+            pKey,
+            pValue
+        };
+
+        static const uint8_t Tokens[256];
+        static const uint8_t Transitions[rCount][kCount];
+
+        // table contents, computed at compile time
+        static constexpr uint8_t tokenOf(int c);
+        static constexpr bool isKeyToken(int k);
+        static constexpr uint8_t actionOf(int row, int k);
+
+        static uint8_t token(char c);
+        static uint8_t transition(uint8_t row, uint8_t k);
+        static char unescape(char c);
+        static bool isValidKey(char c);
+        static bool isEmpty(char c);
+        static bool isDigit(char c);
+
+        // digits and largest value of the numeric field parsed in a state
+        static uint8_t maxDigits(uint8_t state)
+        {
+            return (state == sComponent || state == sId) ? 5 : state == sChecksum ? check::Digits : 3;
+        }
+        static uint32_t maxValue(uint8_t state)
+        {
+            return (state == sComponent || state == sId) ? UINT16_MAX
+                   : state == sChecksum                  ? check::Max
+                                                         : UINT8_MAX;
+        }
+    };
+
+    // Members of the optional parts of a BasicCommand, one base each. A part the config
+    // leaves out is an empty base whose names are statics, used only by code the same
+    // config compiles out.
+    template <typename Cfg, bool On = Cfg::callbacks>
+    struct CallbackPart
+    {
+        void (*cmdCb)(bool, uint16_t, const char *, BasicParams<Cfg> &);
+        void (*errCb)(Result, BasicCommand<Cfg> &);
+    };
+    template <typename Cfg>
+    struct CallbackPart<Cfg, false>
+    {
+        static void (*cmdCb)(bool, uint16_t, const char *, BasicParams<Cfg> &);
+        static void (*errCb)(Result, BasicCommand<Cfg> &);
+    };
+
+    template <typename Cfg, bool On = Cfg::address>
+    struct AddressPart
+    {
+        uint32_t _devAddr;
+        uint8_t _mask[Cfg::segments];
+        uint8_t _maskAny;
+        uint8_t _maskLen;
+        bool _skip;
+    };
+    template <typename Cfg>
+    struct AddressPart<Cfg, false>
+    {
+        static uint32_t _devAddr;
+        static uint8_t _mask[Cfg::segments];
+        static uint8_t _maskAny;
+        static uint8_t _maskLen;
+        static bool _skip;
+    };
+
+    template <typename Cfg, bool On = Cfg::ids>
+    struct IdPart
+    {
+        uint16_t _id;
+        bool _hasId;
+    };
+    template <typename Cfg>
+    struct IdPart<Cfg, false>
+    {
+        static uint16_t _id;
+        static bool _hasId;
+    };
+
+    template <typename Cfg, bool On = Cfg::routing>
+    struct RoutingPart
+    {
+        const Dispatcher *_dispatcher;
+        const Vocabulary *_vocab;
+        uint32_t _hash;
+        uint8_t _ns;
+        typename Cfg::Offset _segs[USC_MAXSEGMENTS];
+        typename Cfg::Offset _segLen[USC_MAXSEGMENTS];
+        uint8_t _segIds[USC_MAXSEGMENTS];
+    };
+    template <typename Cfg>
+    struct RoutingPart<Cfg, false>
+    {
+        static const Dispatcher *_dispatcher;
+        static const Vocabulary *_vocab;
+        static uint32_t _hash;
+        static uint8_t _ns;
+        static typename Cfg::Offset _segs[USC_MAXSEGMENTS];
+        static typename Cfg::Offset _segLen[USC_MAXSEGMENTS];
+        static uint8_t _segIds[USC_MAXSEGMENTS];
     };
 
-    class Command
+    template <typename Cfg, bool On = Cfg::binary>
+    struct BinaryPart
+    {
+        uint8_t _binPhase;
+        uint8_t _binFlags;
+        uint8_t _binLeft;
+    };
+    template <typename Cfg>
+    struct BinaryPart<Cfg, false>
     {
+        static uint8_t _binPhase;
+        static uint8_t _binFlags;
+        static uint8_t _binLeft;
+    };
+
+    template <typename Cfg>
+    class BasicCommand : public CommandBase, CallbackPart<Cfg>, RoutingPart<Cfg>, AddressPart<Cfg>, IdPart<Cfg>,
+                         BinaryPart<Cfg>
+    {
+        static_assert(Cfg::segments <= 8, "an address has at most 8 segments");
+
+        friend class CommandPool;
+        friend class Packet;
+        friend class Frame;
+
     public:
-        Command(uint32_t addr = 0);
+        typedef BasicParams<Cfg> Params;
+        typedef void (*CommandCb)(bool, uint16_t, const char *, Params &);
+        typedef void (*ErrorCb)(Result, BasicCommand &);
+
+        BasicCommand(uint32_t addr = 0);
 
         Result process(char c);
+        size_t process(const char *buf, size_t n, Result &res);
+        uint32_t discarded(void) const;
         bool isBroadcast(void) const;
         bool isResponse(void) const;
         void clear(void);
         char *data(char prefix = 0);
         bool hasChecksum(void) const;
-        uint8_t checksum(void) const;
+        check::Value checksum(void) const;
         uint32_t device(void) const;
         uint16_t component(void) const;
+        bool hasId(void) const;
+        uint16_t id(void) const;
         bool hasAction(void) const;
         const char *action(void) const;
+        uint32_t actionHash(void) const;
+        uint8_t actionSegments(void) const;
+        const char *segment(uint8_t i) const;
+        int segmentLength(uint8_t i) const;
+        uint8_t segmentId(uint8_t i) const;
+        bool segmentIs(uint8_t i, const char *word) const;
         char *beginResponse(void);
-        char *beginResponseCheksum(uint8_t &chk);
+        char *beginResponseCheksum(check::Value &chk);
         char endResponse(void) const;
         Params &params(void);
         void attachCallback(CommandCb fnCmd = nullptr, ErrorCb fnErr = nullptr);
+        void attachDispatcher(const Dispatcher *dispatcher);
+        void attachVocabulary(const Vocabulary *vocab);
         void changeDeviceAddress(uint32_t addr);
         uint32_t deviceAddress() const;
+        bool setAddressFilter(const char *mask = nullptr, bool skip = true);
+        bool matchAddress(void) const;
+#if USC_STATS
+        const BasicStats<Cfg::bufSize> &stats(void) const;
+        void resetStats(void);
+#endif
 
     protected:
         Result processBegin(char c);
         Result processEnd(char c);
         Result processDevice(char c);
         Result processComponent(char c);
+        Result processId(char c);
         Result processAction(char c);
         Result processParamKey(char c);
         Result processParamValue(char c);
         Result processChecksum(char c);
+        Result beginBinary(char c);
+        Result processBinary(char c);
+        Result binaryField(char c);
+        bool append(char c);
+        bool appendNumber(uint16_t v);
+        void hashAction(char c);
+        Result accumulate(char c);
         Result convertDevice(char c, uint8_t ns, Result res = Next);
         Result convertComponent(char c, uint8_t ns, Result res = Next);
+        Result convertId(uint8_t ns, Result res = Next);
+        Result processTable(char c);
+        bool skip(char c);
+        void skipRun(const char *p, const char *e);
         Result doProcess(char c);
+        bool plainDelimiter(char c) const;
+        const char *processRun(const char *p, const char *e);
+        const char *textRun(const char *p, const char *e);
+        const char *binaryRun(const char *p, const char *e);
 
     private:
+        using CallbackPart<Cfg>::cmdCb;
+        using CallbackPart<Cfg>::errCb;
+        using AddressPart<Cfg>::_devAddr;
+        using AddressPart<Cfg>::_mask;
+        using AddressPart<Cfg>::_maskAny;
+        using AddressPart<Cfg>::_maskLen;
+        using AddressPart<Cfg>::_skip;
+        using IdPart<Cfg>::_id;
+        using IdPart<Cfg>::_hasId;
+        using RoutingPart<Cfg>::_dispatcher;
+        using RoutingPart<Cfg>::_vocab;
+        using RoutingPart<Cfg>::_hash;
+        using RoutingPart<Cfg>::_ns;
+        using RoutingPart<Cfg>::_segs;
+        using RoutingPart<Cfg>::_segLen;
+        using RoutingPart<Cfg>::_segIds;
+        using BinaryPart<Cfg>::_binPhase;
+        using BinaryPart<Cfg>::_binFlags;
+        using BinaryPart<Cfg>::_binLeft;
+
+        // largest first, so there is no padding in between
+        Params _params;
+        char *_action;
         uint32_t _device;
+        uint32_t _acc;
+        uint32_t _discarded;
+        int _np;
         uint16_t _component;
+        check::Value _checksum;
         uint8_t _state;
-        uint8_t _checksum;
         bool _hasChecksum;
-        Params _params;
-
         char _pc;
-        int _np, _bp;
         uint8_t _ni;
+        uint8_t _nd;
         bool _capture;
+        uint8_t _error;
+        char _data[Cfg::bufSize + 1];
 
-        char *_action;
-        char _data[USC_BUFSIZE + 1];
+        void splitAction(void);
+        Result notify(void);
 
-        uint32_t _devAddr;
-        ErrorCb errCb;
-        CommandCb cmdCb;
+#if USC_STATS
+        BasicStats<Cfg::bufSize> _stats;
+
+        void count(uint8_t state, size_t n, uint32_t t0);
+        void countResult(Result res);
+#endif
     };
+
+    // Routes of a Dispatcher take a Command, other configurations only use callbacks
+    Result dispatchCommand(const Dispatcher *dispatcher, Command &cmd);
+    uint8_t internSegment(const Vocabulary *vocab, const char *s, size_t n);
+    template <typename C>
+    Result dispatchCommand(const Dispatcher *, C &)
+    {
+        return Next;
+    }
+
+    extern template class BasicParams<DefaultConfig>;
+    extern template class BasicCommand<DefaultConfig>;
 };
 
-#endif
\ No newline at end of file
+#include "USCommandImpl.h"
+
+#endif
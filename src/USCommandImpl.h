@@ -0,0 +1,2156 @@
+#ifndef _USCOMMANDIMPL_H_
+#define _USCOMMANDIMPL_H_
+
+// Members of BasicParams and BasicCommand, included by USCommand.h
+
+#include <string.h>
+#include "USCScan.h"
+
+// time source of Stats::cycles, may be defined as e.g. micros()
+#if USC_STATS && !defined(USC_STATS_CLOCK)
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define USC_STATS_CLOCK() ((uint32_t)__rdtsc())
+#elif defined(ARDUINO)
+#include <Arduino.h>
+#define USC_STATS_CLOCK() ((uint32_t)micros())
+#else
+#define USC_STATS_CLOCK() 0
+#endif
+#endif
+
+namespace usc
+{
+    inline bool CommandBase::isOpen(uint8_t state)
+    {
+        return state != sBegin;
+    }
+    inline uint8_t CommandBase::token(char c)
+    {
+#if defined(__AVR__)
+        return pgm_read_byte(&Tokens[(uint8_t)c]);
+#else
+        return Tokens[(uint8_t)c];
+#endif
+    }
+    inline uint8_t CommandBase::transition(uint8_t row, uint8_t k)
+    {
+#if defined(__AVR__)
+        return pgm_read_byte(&Transitions[row][k]);
+#else
+        return Transitions[row][k];
+#endif
+    }
+    inline bool CommandBase::isValidKey(char c)
+    {
+        return scan::is(c, scan::cKey);
+    }
+    inline bool CommandBase::isEmpty(char c)
+    {
+        return scan::is(c, scan::cSpace);
+    }
+    inline bool CommandBase::isDigit(char c)
+    {
+        return scan::is(c, scan::cDigit);
+    }
+    inline char CommandBase::unescape(char c)
+    {
+        if (!scan::is(c, scan::cEscape))
+        {
+            return 0;
+        }
+        switch (c)
+        {
+        case 'r':
+            return '\r';
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'b':
+            return '\b';
+        }
+        return c;
+    }
+
+    template <typename Cfg>
+    BasicParams<Cfg>::BasicParams()
+    {
+        clear();
+    }
+
+    template <typename Cfg>
+    void BasicParams<Cfg>::clear()
+    {
+        _data = nullptr;
+        if (Cfg::routing)
+        {
+            _args = nullptr;
+        }
+        _count = 0;
+        _next = 0;
+        _kv.clear();
+    }
+
+    template <typename Cfg>
+    BasicParams<Cfg> &BasicParams<Cfg>::begin()
+    {
+        _kv.clear();
+        _next = 0;
+
+        return *this;
+    }
+    template <typename Cfg>
+    void BasicParams<Cfg>::begin(const char *data, int key)
+    {
+        _data = data;
+        _count = 0;
+        _next = 0;
+        _index[0].key = key;
+    }
+    template <typename Cfg>
+    bool BasicParams<Cfg>::nextKey(int key)
+    {
+        if (_count >= Cfg::maxParams)
+        {
+            return false;
+        }
+        _index[_count].key = key;
+        return true;
+    }
+    template <typename Cfg>
+    void BasicParams<Cfg>::addKey(int end)
+    {
+        ParamEntry &en = _index[_count++];
+        en.klen = end - en.key;
+        en.value = 0;
+        en.vlen = 0;
+        en.uncache();
+    }
+    template <typename Cfg>
+    void BasicParams<Cfg>::addValue(int end)
+    {
+        ParamEntry &en = _index[_count++];
+        en.klen = end - en.key;
+        en.value = end + 1;
+        en.vlen = 0;
+        en.uncache();
+    }
+    template <typename Cfg>
+    void BasicParams<Cfg>::endValue(int end)
+    {
+        ParamEntry &en = _index[_count - 1];
+        en.vlen = end - en.value;
+    }
+    template <typename Cfg>
+    bool BasicParams<Cfg>::next()
+    {
+        if (_next >= _count)
+        {
+            return false;
+        }
+        _kv = (*this)[_next++];
+        return true;
+    }
+    template <typename Cfg>
+    KeyVal BasicParams<Cfg>::operator[](int i) const
+    {
+        if (i >= 0 && i < _count)
+        {
+            return KeyVal(_data, _index[i]);
+        }
+        return KeyVal();
+    }
+    template <typename Cfg>
+    KeyVal BasicParams<Cfg>::find(const char *key) const
+    {
+        size_t n = strlen(key);
+        for (int i = 0; i < _count; i++)
+        {
+            const ParamEntry &en = _index[i];
+            if (en.klen == n && memcmp(_data + en.key, key, n) == 0)
+            {
+                return (*this)[i];
+            }
+        }
+        return KeyVal();
+    }
+    template <typename Cfg>
+    const KeyVal &BasicParams<Cfg>::kv() const
+    {
+        return _kv;
+    }
+    template <typename Cfg>
+    int BasicParams<Cfg>::count() const
+    {
+        return _count;
+    }
+    template <typename Cfg>
+    bool BasicParams<Cfg>::empty() const
+    {
+        return _count == 0;
+    }
+
+    template <typename Cfg>
+    const void *ArgsPart<Cfg, false>::_args;
+    template <typename Cfg>
+    void (*CallbackPart<Cfg, false>::cmdCb)(bool, uint16_t, const char *, BasicParams<Cfg> &);
+    template <typename Cfg>
+    void (*CallbackPart<Cfg, false>::errCb)(Result, BasicCommand<Cfg> &);
+    template <typename Cfg>
+    uint32_t AddressPart<Cfg, false>::_devAddr;
+    template <typename Cfg>
+    uint8_t AddressPart<Cfg, false>::_mask[Cfg::segments];
+    template <typename Cfg>
+    uint8_t AddressPart<Cfg, false>::_maskAny;
+    template <typename Cfg>
+    uint8_t AddressPart<Cfg, false>::_maskLen;
+    template <typename Cfg>
+    bool AddressPart<Cfg, false>::_skip;
+    template <typename Cfg>
+    uint16_t IdPart<Cfg, false>::_id;
+    template <typename Cfg>
+    bool IdPart<Cfg, false>::_hasId;
+    template <typename Cfg>
+    const Dispatcher *RoutingPart<Cfg, false>::_dispatcher;
+    template <typename Cfg>
+    const Vocabulary *RoutingPart<Cfg, false>::_vocab;
+    template <typename Cfg>
+    uint32_t RoutingPart<Cfg, false>::_hash;
+    template <typename Cfg>
+    uint8_t RoutingPart<Cfg, false>::_ns;
+    template <typename Cfg>
+    typename Cfg::Offset RoutingPart<Cfg, false>::_segs[USC_MAXSEGMENTS];
+    template <typename Cfg>
+    typename Cfg::Offset RoutingPart<Cfg, false>::_segLen[USC_MAXSEGMENTS];
+    template <typename Cfg>
+    uint8_t RoutingPart<Cfg, false>::_segIds[USC_MAXSEGMENTS];
+    template <typename Cfg>
+    uint8_t BinaryPart<Cfg, false>::_binPhase;
+    template <typename Cfg>
+    uint8_t BinaryPart<Cfg, false>::_binFlags;
+    template <typename Cfg>
+    uint8_t BinaryPart<Cfg, false>::_binLeft;
+
+    template <typename Cfg>
+    BasicCommand<Cfg>::BasicCommand(uint32_t dev)
+    {
+        if (Cfg::callbacks)
+        {
+            cmdCb = nullptr;
+            errCb = nullptr;
+        }
+        if (Cfg::routing)
+        {
+            _dispatcher = nullptr;
+            _vocab = nullptr;
+        }
+        if (Cfg::address)
+        {
+            _devAddr = dev;
+            _maskAny = 0;
+            _maskLen = 0;
+            _skip = false;
+        }
+        _error = OK;
+        _discarded = 0;
+#if USC_STATS
+        resetStats();
+#endif
+        clear();
+    }
+
+    template <typename Cfg>
+    void BasicCommand<Cfg>::clear(void)
+    {
+        _pc = '\0';
+        _np = 0;
+        _ni = 0;
+        _nd = 0;
+        _acc = 0;
+        _state = sBegin;
+        _device = InvalidDevice;
+        _component = 0;
+        if (Cfg::ids)
+        {
+            _id = 0;
+            _hasId = false;
+        }
+        if (Cfg::binary)
+        {
+            _binPhase = bLength;
+            _binFlags = 0;
+            _binLeft = 0;
+        }
+        _capture = false;
+        _checksum = check::Init;
+        _hasChecksum = false;
+        _data[0] = 0;
+        _data[1] = 0;
+        _action = nullptr;
+        if (Cfg::routing)
+        {
+            _hash = USC_HASH_BASIS;
+            _ns = 0;
+        }
+        _params.clear();
+    }
+
+    template <typename Cfg>
+    uint32_t BasicCommand<Cfg>::device(void) const
+    {
+        return _device;
+    }
+    template <typename Cfg>
+    void BasicCommand<Cfg>::changeDeviceAddress(uint32_t addr) 
+    {
+        static_assert(Cfg::address, "the config has no own address (FeatureAddress)");
+        _devAddr = addr;
+    }
+    template <typename Cfg>
+    uint32_t BasicCommand<Cfg>::deviceAddress() const {
+        return Cfg::address ? _devAddr : (uint32_t)Broadcast;
+    }
+
+    // Frames for this device and broadcasts are always accepted, a mask like `0.0.2.*`
+    // accepts a group of devices as well. With skip, the rest of a frame for another
+    // device is passed over once its address is complete, without a result.
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::setAddressFilter(const char *mask, bool skip)
+    {
+        static_assert(Cfg::address, "the config has no own address (FeatureAddress)");
+        _maskAny = 0;
+        _maskLen = 0;
+        _skip = false;
+        if (mask == nullptr)
+        {
+            _skip = skip;
+            return true;
+        }
+
+        uint8_t n = 0;
+        const char *p = mask;
+        while (true)
+        {
+            if (n >= Cfg::segments)
+            {
+                return false;
+            }
+            _mask[n] = 0;
+            if (*p == '*')
+            {
+                _maskAny |= 1 << n;
+                p++;
+            }
+            else
+            {
+                uint16_t v = 0;
+                uint8_t nd = 0;
+                for (; isDigit(*p); p++)
+                {
+                    v = v * 10 + (uint8_t)(*p - '0');
+                    if (++nd > 3 || v > UINT8_MAX)
+                    {
+                        return false;
+                    }
+                }
+                if (nd == 0)
+                {
+                    return false;
+                }
+                _mask[n] = (uint8_t)v;
+            }
+            n++;
+            if (*p == 0)
+            {
+                break;
+            }
+            if (*p != '.' && *p != '-' && *p != '_')
+            {
+                return false;
+            }
+            p++;
+        }
+        _maskLen = n;
+        _skip = skip;
+        return true;
+    }
+
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::matchAddress(void) const
+    {
+        if (!Cfg::address || isBroadcast() || _device == _devAddr)
+        {
+            return true;
+        }
+        if (_maskLen == 0)
+        {
+            return false;
+        }
+
+        // segments of the received address, right aligned with the mask, missing
+        // leading segments are 0 like in the device number
+        uint8_t seg[Cfg::segments];
+        uint8_t n = 0;
+        seg[0] = 0;
+        for (const char *p = _data + 1; n < _ni; p++)
+        {
+            if (isDigit(*p))
+            {
+                seg[n] = seg[n] * 10 + (uint8_t)(*p - '0');
+            }
+            else if (++n < _ni)
+            {
+                seg[n] = 0;
+            }
+        }
+        uint8_t len = n > _maskLen ? n : _maskLen;
+        for (uint8_t j = 0; j < len; j++)
+        {
+            int fi = j - (len - n);
+            int mi = j - (len - _maskLen);
+            uint8_t v = fi >= 0 ? seg[fi] : 0;
+            if (mi < 0 ? v != 0 : ((_maskAny >> mi) & 1) == 0 && _mask[mi] != v)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Cfg>
+    uint16_t BasicCommand<Cfg>::component(void) const
+    {
+        return _component;
+    }
+
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::hasId(void) const
+    {
+        return Cfg::ids && _hasId;
+    }
+    template <typename Cfg>
+    uint16_t BasicCommand<Cfg>::id(void) const
+    {
+        return Cfg::ids ? _id : 0;
+    }
+
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::isBroadcast(void) const
+    {
+        return _device == USC_BROADCAST_ADDR;
+    }
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::isResponse(void) const
+    {
+        return _data[0] == '@';
+    }
+    template <typename Cfg>
+    char *BasicCommand<Cfg>::data(char prefix)
+    {
+        if (prefix != 0)
+        {
+            _data[0] = prefix;
+        }
+        return _data;
+    }
+    template <typename Cfg>
+    char *BasicCommand<Cfg>::beginResponse()
+    {
+        _data[0] = '@';
+        return _data;
+    }
+    template <typename Cfg>
+    char BasicCommand<Cfg>::endResponse() const
+    {
+        return '$';
+    }
+    template <typename Cfg>
+    char *BasicCommand<Cfg>::beginResponseCheksum(check::Value &chk)
+    {
+        char *resp = beginResponse();
+        chk = check::update(check::Init, resp, strlen(resp));
+        return resp;
+    }
+
+    template <typename Cfg>
+    check::Value BasicCommand<Cfg>::checksum(void) const
+    {
+        return _checksum;
+    }
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::hasChecksum(void) const
+    {
+        return _hasChecksum;
+    }
+
+    template <typename Cfg>
+    const char *BasicCommand<Cfg>::action(void) const
+    {
+        return _action ? _action : "";
+    }
+
+    template <typename Cfg>
+    uint32_t BasicCommand<Cfg>::actionHash(void) const
+    {
+        if (Cfg::routing)
+        {
+            return _hash;
+        }
+        uint32_t h = USC_HASH_BASIS;
+        for (const char *p = action(); *p != 0; p++)
+        {
+            h = hashStep(h, *p);
+        }
+        return h;
+    }
+
+    template <typename Cfg>
+    uint8_t BasicCommand<Cfg>::actionSegments(void) const
+    {
+        return Cfg::routing ? _ns : 0;
+    }
+    // segment i of the action, ends at the next `/` or the end of action()
+    template <typename Cfg>
+    const char *BasicCommand<Cfg>::segment(uint8_t i) const
+    {
+        return i < actionSegments() ? _data + _segs[i] : "";
+    }
+    template <typename Cfg>
+    int BasicCommand<Cfg>::segmentLength(uint8_t i) const
+    {
+        return i < actionSegments() ? _segLen[i] : 0;
+    }
+    // index of the segment in the attached Vocabulary, UnknownSegment if it is not there
+    template <typename Cfg>
+    uint8_t BasicCommand<Cfg>::segmentId(uint8_t i) const
+    {
+        return i < actionSegments() ? _segIds[i] : (uint8_t)UnknownSegment;
+    }
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::segmentIs(uint8_t i, const char *word) const
+    {
+        size_t n = strlen(word);
+        return i < actionSegments() && _segLen[i] == n && memcmp(_data + _segs[i], word, n) == 0;
+    }
+
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::hasAction() const
+    {
+        return _action != nullptr && *_action != 0;
+    }
+
+    template <typename Cfg>
+    BasicParams<Cfg> &BasicCommand<Cfg>::params()
+    {
+        return _params;
+    }
+
+    template <typename Cfg>
+    void BasicCommand<Cfg>::attachCallback(CommandCb fnCmd, ErrorCb fnErr) {
+        static_assert(Cfg::callbacks, "the config has no callbacks (FeatureCallbacks)");
+        this->cmdCb = fnCmd;
+        this->errCb = fnErr;
+    }
+    template <typename Cfg>
+    void BasicCommand<Cfg>::attachDispatcher(const Dispatcher *dispatcher) {
+        static_assert(Cfg::routing, "the config has no routing (FeatureRouting)");
+        _dispatcher = dispatcher;
+    }
+    template <typename Cfg>
+    void BasicCommand<Cfg>::attachVocabulary(const Vocabulary *vocab) {
+        static_assert(Cfg::routing, "the config has no routing (FeatureRouting)");
+        _vocab = vocab;
+    }
+
+    // the action hash is kept while parsing for routing, actionHash() works it out otherwise
+    template <typename Cfg>
+    void BasicCommand<Cfg>::hashAction(char c)
+    {
+        if (Cfg::routing)
+        {
+            _hash = hashStep(_hash, c);
+        }
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::accumulate(char c)
+    {
+        if (++_nd > maxDigits(_state))
+        {
+            return Unexpected;
+        }
+        if (check::Hex && _state == sChecksum)
+        {
+            // the table engine sends letters here too
+            if (!check::isDigit(c))
+            {
+                return Unexpected;
+            }
+            _acc = _acc * 16 + check::digitOf(c);
+            return Next;
+        }
+        _acc = _acc * 10 + (uint8_t)(c - '0');
+        if (_acc > maxValue(_state))
+        {
+            return Overflow;
+        }
+        return Next;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::convertDevice(char c, uint8_t ns, Result res)
+    {
+        if (_ni == 0)
+        {
+            _device = 0;
+        }
+        _ni++;
+
+        // invalid address segment count
+        if (_ni > Cfg::segments)
+        {
+            return Unexpected;
+        }
+
+        // assign address, digits are already accumulated
+        _device <<= 4;
+        _device |= _acc;
+        _acc = 0;
+        _nd = 0;
+        _state = ns;
+
+        // the address is complete, the frame is skipped when it is not ours
+        if (Cfg::address && _skip && ns != sDevice && ns != sBegin && !matchAddress())
+        {
+            _state = sSkip;
+#if USC_STATS
+            _stats.skipped++;
+#endif
+        }
+
+        return res;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::convertComponent(char c, uint8_t ns, Result res)
+    {
+        _component = (uint16_t)_acc;
+        _acc = 0;
+        _nd = 0;
+        _state = ns;
+
+        return res;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::convertId(uint8_t ns, Result res)
+    {
+        if (Cfg::ids)
+        {
+            _id = (uint16_t)_acc;
+            _hasId = true;
+        }
+        _acc = 0;
+        _nd = 0;
+        _state = ns;
+
+        return res;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processBegin(char c)
+    {
+        switch (c)
+        {
+        case '!':
+            _state = sDevice;
+            _np = 0;
+            _ni = 0;
+            _capture = true;
+            _data[_np++] = c;
+            _checksum = check::step(_checksum, c);
+            return Next;
+        case '@':
+            if (!Cfg::responses)
+            {
+                return Unexpected;
+            }
+            _state = sEnd;
+            _np = 0;
+            _data[_np++] = c;
+            _data[_np] = 0;
+            return Next;
+        }
+
+        return Unexpected;
+    }
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processEnd(char c)
+    {
+        if (Cfg::escape && _pc == '\\')
+        {
+            return unescape(c) != 0 ? Next : Unexpected;
+        }
+        else if (c == '$')
+        {
+            _state = sBegin;
+            _capture = false;
+            return OK;
+        }
+
+        return Next;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processDevice(char c)
+    {
+        // wait terminated
+        if (isDigit(c))
+        {
+            return accumulate(c);
+        }
+
+        switch (c)
+        {
+        case '-':
+        case '_':
+        case '.':
+            return convertDevice(c, sDevice);
+        case ':':
+            // set default component address
+            _component = USC_DEFAULT_COMPONENT;
+            return convertDevice(c, sComponent);
+        case '/':
+            _action = _data + _np;
+            return convertDevice(c, sAction);
+        case '|':
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _data[_np - 1] = 0;
+            return convertDevice(c, sChecksum);
+        case '$':
+            _data[_np - 1] = 0;
+            return convertDevice(c, sBegin, OK);
+        case '#':
+            return convertDevice(c, sId);
+        }
+
+        return Unexpected;
+    }
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processComponent(char c)
+    {
+        // check for overflow
+        if (isDigit(c))
+        {
+            return accumulate(c);
+        }
+
+        switch (c)
+        {
+        case '/':
+            _action = _data + _np;
+            return convertComponent(c, sAction);
+        case '|':
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _data[_np - 1] = 0;
+            return convertComponent(c, sChecksum);
+        case '$':
+            _data[_np - 1] = 0;
+            return convertComponent(c, sBegin, OK);
+        case '#':
+            return convertComponent(c, sId);
+        }
+
+        return Unexpected;
+    }
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processId(char c)
+    {
+        if (isDigit(c))
+        {
+            return accumulate(c);
+        }
+
+        switch (c)
+        {
+        case '/':
+            _action = _data + _np;
+            return convertId(sAction);
+        case '|':
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _data[_np - 1] = 0;
+            return convertId(sChecksum);
+        case '$':
+            _data[_np - 1] = 0;
+            return convertId(sBegin, OK);
+        }
+
+        return Unexpected;
+    }
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processAction(char c)
+    {
+        // Check if c is valid
+        if (isValidKey(c) || (c == '/' && _pc != '/'))
+        {
+            hashAction(c);
+            return Next;
+        }
+
+        switch (c)
+        {
+        case '?':
+            _state = sParamKey;
+            _params.begin(_data, _np);
+            _data[_np - 1] = 0;
+            return Next;
+        case '|':
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _state = sChecksum;
+            _data[_np - 1] = 0;
+            return Next;
+        case '$':
+            _state = sBegin;
+            _data[_np - 1] = 0;
+            return OK;
+        }
+        return Unexpected;
+    }
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processParamKey(char c)
+    {
+        // Check if c is valid
+        if (isValidKey(c))
+        {
+            return Next;
+        }
+        switch (c)
+        {
+        case '=':
+            _state = sParamValue;
+            _data[_np - 1] = 0;
+            _params.addValue(_np - 1);
+            return Next;
+        case '|':
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _state = sChecksum;
+            _data[_np - 1] = 0;
+            _params.addKey(_np - 1);
+            return Next;
+        case '$':
+            _state = sBegin;
+            _data[_np - 1] = 0;
+            _params.addKey(_np - 1);
+            return OK;
+        }
+        return Unexpected;
+    }
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processParamValue(char c)
+    {
+        switch (c)
+        {
+        case '&':
+            _state = sParamKey;
+            _data[_np - 1] = 0;
+            _params.endValue(_np - 1);
+            return _params.nextKey(_np) ? Next : Overflow;
+        case '|':
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _state = sChecksum;
+            _data[_np - 1] = 0;
+            _params.endValue(_np - 1);
+            return Next;
+        case '$':
+            _state = sBegin;
+            _data[_np - 1] = 0;
+            _params.endValue(_np - 1);
+            return OK;
+        }
+        return Next;
+    }
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processChecksum(char c)
+    {
+        if (check::isDigit(c))
+        {
+            return accumulate(c);
+        }
+        else if (c == '$')
+        {
+            // a CRC is always written with all its digits
+            if (check::Hex && _nd != check::Digits)
+            {
+                return Unexpected;
+            }
+            _state = sBegin;
+            _hasChecksum = true;
+
+            // compare checksum
+            if (_acc != _checksum)
+            {
+#if USC_STATS
+                _stats.checksums++;
+#endif
+                return Invalid;
+            }
+            return OK;
+        }
+        return Unexpected;
+    }
+
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::append(char c)
+    {
+        if (_np >= Cfg::bufSize)
+        {
+            return false;
+        }
+        _data[_np++] = c;
+        _data[_np] = 0;
+        return true;
+    }
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::appendNumber(uint16_t v)
+    {
+        char digits[5];
+        uint8_t n = 0;
+        do
+        {
+            digits[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        while (n > 0)
+        {
+            if (!append(digits[--n]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A binary frame is written to the buffer as its text form, so data(),
+    // beginResponse(), params() and the address filter work unchanged.
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::beginBinary(char c)
+    {
+        _state = sBinary;
+        _binPhase = bLength;
+        _np = 0;
+        _ni = 0;
+        _data[_np++] = '!';
+        _data[_np] = 0;
+        _checksum = check::step(_checksum, c);
+        return Next;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processBinary(char c)
+    {
+        switch (_binPhase)
+        {
+        case bDiscard:
+        case bSkip:
+            // a discarded frame is passed over like a skipped one, and counted
+            if (_binPhase == bDiscard)
+            {
+                _discarded++;
+#if USC_STATS
+                _stats.discarded++;
+#endif
+            }
+            if (_binLeft > 0)
+            {
+                _binLeft--;
+            }
+            else if (++_nd == sizeof(check::Value))
+            {
+                _state = _binPhase == bSkip ? sBegin : sError;
+            }
+            return Next;
+        case bChecksum:
+            _acc |= (uint32_t)(uint8_t)c << (8 * _nd);
+            if (++_nd < sizeof(check::Value))
+            {
+                return Next;
+            }
+            _state = sBegin;
+            _hasChecksum = true;
+            if (_acc != _checksum)
+            {
+#if USC_STATS
+                _stats.checksums++;
+#endif
+                return Invalid;
+            }
+            return OK;
+        case bLength:
+            if (c == 0)
+            {
+                return Unexpected;
+            }
+            _checksum = check::step(_checksum, c);
+            _binLeft = (uint8_t)c;
+            _binPhase = bFlags;
+            return Next;
+        }
+
+        // bytes counted by len
+        _checksum = check::step(_checksum, c);
+        _binLeft--;
+        Result res = binaryField(c);
+        if (res != Next && _binPhase == bFlags)
+        {
+            // no header, the STX was noise in front of a text frame starting at len
+            char s = (char)(_binLeft + 1);
+            if (s == '!' || (Cfg::responses && s == '@'))
+            {
+                clear();
+                doProcess(s);
+                return doProcess(c);
+            }
+            return res;
+        }
+        if (res != Next || _binLeft != 0 || _binPhase == bSkip)
+        {
+            return res;
+        }
+
+        // the fields end with the address, the action or a param
+        if (_binPhase != bActionLength && _binPhase != bKeyLength)
+        {
+            return Unexpected;
+        }
+        _binPhase = bChecksum;
+        _acc = 0;
+        _nd = 0;
+        return Next;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::binaryField(char c)
+    {
+        uint8_t b = (uint8_t)c;
+        switch (_binPhase)
+        {
+        case bFlags:
+            // the header must hold the address, component and id it announces
+            if ((b & BinarySegments) == 0 || (b & BinarySegments) > Cfg::segments ||
+                (b & ~(BinarySegments | BinaryComponent | BinaryId)) != BinaryMarker ||
+                _binLeft < (b & BinarySegments) + ((b & BinaryComponent) ? 2 : 0) + ((b & BinaryId) ? 2 : 0))
+            {
+                return Unexpected;
+            }
+            _binFlags = b;
+            _device = 0;
+            _binPhase = bAddress;
+            return Next;
+        case bAddress:
+            if ((_ni > 0 && !append('.')) || !appendNumber(b))
+            {
+                return Overflow;
+            }
+            _device <<= 4;
+            _device |= b;
+            if (++_ni < (_binFlags & BinarySegments))
+            {
+                return Next;
+            }
+
+            // the rest of a frame which is not ours is passed over by length
+            if (Cfg::address && _skip && !matchAddress())
+            {
+                _binPhase = bSkip;
+                _nd = 0;
+#if USC_STATS
+                _stats.skipped++;
+#endif
+                return Next;
+            }
+            _acc = 0;
+            _nd = 0;
+            _binPhase = (_binFlags & BinaryComponent) ? bComponent : (_binFlags & BinaryId) ? bId : bActionLength;
+            return Next;
+        case bComponent:
+            _acc |= (uint32_t)b << (8 * _nd);
+            if (++_nd < 2)
+            {
+                return Next;
+            }
+            _component = (uint16_t)_acc;
+            if (!append(':') || !appendNumber(_component))
+            {
+                return Overflow;
+            }
+            _acc = 0;
+            _nd = 0;
+            _binPhase = (_binFlags & BinaryId) ? bId : bActionLength;
+            return Next;
+        case bId:
+            _acc |= (uint32_t)b << (8 * _nd);
+            if (++_nd < 2)
+            {
+                return Next;
+            }
+            if (Cfg::ids)
+            {
+                _id = (uint16_t)_acc;
+                _hasId = true;
+            }
+            if (!append('#') || !appendNumber((uint16_t)_acc))
+            {
+                return Overflow;
+            }
+            _acc = 0;
+            _nd = 0;
+            _binPhase = bActionLength;
+            return Next;
+        case bActionLength:
+            if (b == 0)
+            {
+                _binPhase = bKeyLength;
+                return Next;
+            }
+            if (!append('/'))
+            {
+                return Overflow;
+            }
+            _action = _data + _np;
+            _pc = '/';
+            _nd = b;
+            _binPhase = bAction;
+            return Next;
+        case bAction:
+            if (!isValidKey(c) && (c != '/' || _pc == '/'))
+            {
+                return Unexpected;
+            }
+            if (!append(c))
+            {
+                return Overflow;
+            }
+            hashAction(c);
+            _pc = c;
+            if (--_nd == 0)
+            {
+                _binPhase = bKeyLength;
+            }
+            return Next;
+        case bKeyLength:
+            // the 0 in place of `?` ends the header
+            if (_params.count() == 0)
+            {
+                if (!append(0))
+                {
+                    return Overflow;
+                }
+                _params.begin(_data, _np);
+            }
+            else if (!_params.nextKey(_np))
+            {
+                return Overflow;
+            }
+            _nd = b;
+            _binPhase = b > 0 ? bKey : bValueLength;
+            return Next;
+        case bKey:
+            if (!isValidKey(c))
+            {
+                return Unexpected;
+            }
+            if (!append(c))
+            {
+                return Overflow;
+            }
+            if (--_nd == 0)
+            {
+                _binPhase = bValueLength;
+            }
+            return Next;
+        case bValueLength:
+            if (!append(0))
+            {
+                return Overflow;
+            }
+            if (b == BinaryNoValue)
+            {
+                _params.addKey(_np - 1);
+                _binPhase = bKeyLength;
+                return Next;
+            }
+            _params.addValue(_np - 1);
+            _nd = b;
+            _binPhase = bValue;
+            if (b > 0)
+            {
+                return Next;
+            }
+            break;
+        case bValue:
+            // any byte, the length is known
+            if (!append(c))
+            {
+                return Overflow;
+            }
+            if (--_nd > 0)
+            {
+                return Next;
+            }
+            break;
+        default:
+            return Unexpected;
+        }
+
+        // end of a value
+        _params.endValue(_np);
+        if (!append(0))
+        {
+            return Overflow;
+        }
+        _binPhase = bKeyLength;
+        return Next;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::processTable(char c)
+    {
+        uint8_t row = _state;
+        if (Cfg::escape && row == sEnd && _pc == '\\')
+        {
+            row = rEndEscape;
+        }
+        uint8_t k = token(c);
+
+        switch (transition(row, k))
+        {
+        case aNext:
+            return Next;
+        case aBeginCommand:
+            _state = sDevice;
+            _np = 0;
+            _ni = 0;
+            _capture = true;
+            _data[_np++] = c;
+            _checksum = check::step(_checksum, c);
+            return Next;
+        case aBeginResponse:
+            if (!Cfg::responses)
+            {
+                return Unexpected;
+            }
+            _state = sEnd;
+            _np = 0;
+            _data[_np++] = c;
+            _data[_np] = 0;
+            return Next;
+        case aEndEscape:
+            return unescape(c) != 0 ? Next : Unexpected;
+        case aEndDone:
+            _state = sBegin;
+            _capture = false;
+            return OK;
+        case aDigit:
+            return accumulate(c);
+        case aDevSeparator:
+            return convertDevice(c, sDevice);
+        case aDevComponent:
+            _component = USC_DEFAULT_COMPONENT;
+            return convertDevice(c, sComponent);
+        case aDevAction:
+            _action = _data + _np;
+            return convertDevice(c, sAction);
+        case aDevChecksum:
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _data[_np - 1] = 0;
+            return convertDevice(c, sChecksum);
+        case aDevDone:
+            _data[_np - 1] = 0;
+            return convertDevice(c, sBegin, OK);
+        case aDevId:
+            return convertDevice(c, sId);
+        case aCompAction:
+            _action = _data + _np;
+            return convertComponent(c, sAction);
+        case aCompChecksum:
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _data[_np - 1] = 0;
+            return convertComponent(c, sChecksum);
+        case aCompDone:
+            _data[_np - 1] = 0;
+            return convertComponent(c, sBegin, OK);
+        case aCompId:
+            return convertComponent(c, sId);
+        case aIdAction:
+            _action = _data + _np;
+            return convertId(sAction);
+        case aIdChecksum:
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _data[_np - 1] = 0;
+            return convertId(sChecksum);
+        case aIdDone:
+            _data[_np - 1] = 0;
+            return convertId(sBegin, OK);
+        case aActChar:
+            hashAction(c);
+            return Next;
+        case aActSlash:
+            if (_pc == '/')
+            {
+                return Unexpected;
+            }
+            hashAction(c);
+            return Next;
+        case aActParams:
+            _state = sParamKey;
+            _params.begin(_data, _np);
+            _data[_np - 1] = 0;
+            return Next;
+        case aActChecksum:
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _state = sChecksum;
+            _data[_np - 1] = 0;
+            return Next;
+        case aActDone:
+            _state = sBegin;
+            _data[_np - 1] = 0;
+            return OK;
+        case aKeyValue:
+            _state = sParamValue;
+            _data[_np - 1] = 0;
+            _params.addValue(_np - 1);
+            return Next;
+        case aKeyChecksum:
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _state = sChecksum;
+            _data[_np - 1] = 0;
+            _params.addKey(_np - 1);
+            return Next;
+        case aKeyDone:
+            _state = sBegin;
+            _data[_np - 1] = 0;
+            _params.addKey(_np - 1);
+            return OK;
+        case aValKey:
+            _state = sParamKey;
+            _data[_np - 1] = 0;
+            _params.endValue(_np - 1);
+            return _params.nextKey(_np) ? Next : Overflow;
+        case aValChecksum:
+            if (!Cfg::checksum)
+            {
+                return Unexpected;
+            }
+            _state = sChecksum;
+            _data[_np - 1] = 0;
+            _params.endValue(_np - 1);
+            return Next;
+        case aValDone:
+            _state = sBegin;
+            _data[_np - 1] = 0;
+            _params.endValue(_np - 1);
+            return OK;
+        case aChkDone:
+            if (check::Hex && _nd != check::Digits)
+            {
+                return Unexpected;
+            }
+            _state = sBegin;
+            _hasChecksum = true;
+            if (_acc != _checksum)
+            {
+#if USC_STATS
+                _stats.checksums++;
+#endif
+                return Invalid;
+            }
+            return OK;
+        }
+        return Unexpected;
+    }
+
+    // Passes over a frame which is not ours up to `$`, nothing is stored or checked.
+    // A backslash escapes the next byte anywhere in it and the params are followed, so
+    // a start marker outside a value breaks the frame like in a parsed one; true when c
+    // starts the next frame.
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::skip(char c)
+    {
+        if (Cfg::escape && _pc == '\\')
+        {
+            _pc = 0;
+            return false;
+        }
+        _pc = c;
+        switch (c)
+        {
+        case '$':
+            _state = sBegin;
+            return false;
+        case '?':
+            if (_nd == pHeader)
+            {
+                _nd = pKey;
+            }
+            return false;
+        case '=':
+            if (_nd == pKey)
+            {
+                _nd = pValue;
+            }
+            return false;
+        case '&':
+            if (_nd == pValue)
+            {
+                _nd = pKey;
+            }
+            return false;
+        case '|':
+            _nd = pHeader;
+            return false;
+        }
+        if (_nd != pValue && (c == '!' || (Cfg::responses && c == '@') || (Cfg::binary && c == USC_BINARY_START)))
+        {
+            _state = sBegin;
+            return true;
+        }
+        return false;
+    }
+
+    // skip() over a run without an unescaped start marker or `$`, only the structural
+    // characters change where it is
+    template <typename Cfg>
+    void BasicCommand<Cfg>::skipRun(const char *p, const char *e)
+    {
+        while (p != e)
+        {
+            const char *q = scan::findStructural(p, e);
+            if (q != p)
+            {
+                _pc = 0;
+            }
+            if (q == e)
+            {
+                break;
+            }
+            skip(*q);
+            p = q + 1;
+        }
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::doProcess(char c)
+    {
+        if (_state == sSkip && !skip(c))
+        {
+            return Next;
+        }
+        if (Cfg::binary && _state == sBinary)
+        {
+            return processBinary(c);
+        }
+        if (_state == sBegin) {
+            if (isEmpty(c)) {
+                return Next;
+            } else if (c == '!' || c == '@') {
+                clear();
+            } else if (Cfg::binary && c == USC_BINARY_START) {
+                clear();
+                return beginBinary(c);
+            }
+        }
+        // a stray byte between frames is not stored behind the last one
+        if (_capture && _state != sBegin)
+        {
+            if (Cfg::checksum && _state != sChecksum && _state != sEnd)
+            {
+                _checksum = check::step(_checksum, c);
+            }
+            // Save to buffer
+            if (_np >= Cfg::bufSize)
+            {
+                return Overflow;
+            }
+            else if (Cfg::escape && _pc == '\\')
+            {
+                if (_state != sParamValue)
+                {
+                    // escape char only allowed in param value
+                    return Unexpected;
+                }
+                char ec = unescape(c);
+                if (ec != 0)
+                {
+                    _data[_np - 1] = ec;
+                    _data[_np] = 0;
+                    if (ec == '\\')
+                    {
+                        _pc = 0;
+                    }
+                    else
+                    {
+                        _pc = c;
+                    }
+                    return Next;
+                }
+                return Invalid;
+            }
+            _data[_np++] = c;
+            _data[_np] = 0;
+        }
+
+        // process, an escaped byte of a response does not escape the next one
+        bool escaped = Cfg::escape && _state == sEnd && _pc == '\\';
+#if USC_TABLE_ENGINE
+        Result res = processTable(c);
+#else
+        Result res;
+        switch (_state)
+        {
+        case sBegin:
+            res = processBegin(c);
+            break;
+        case sEnd:
+            res = processEnd(c);
+            break;
+        case sDevice:
+            res = processDevice(c);
+            break;
+        case sComponent:
+            res = processComponent(c);
+            break;
+        case sId:
+            res = processId(c);
+            break;
+        case sAction:
+            res = processAction(c);
+            break;
+        case sParamKey:
+            res = processParamKey(c);
+            break;
+        case sParamValue:
+            res = processParamValue(c);
+            break;
+        case sChecksum:
+            res = processChecksum(c);
+            break;
+        default:
+            res = Unexpected;
+            break;
+        }
+#endif
+
+        // save character as previous
+        _pc = escaped ? 0 : c;
+
+        return res;
+    }
+
+    // True when c, at the end of a run, takes the frame to the next field without a
+    // result, so processRun() goes on behind it. The rest of the delimiters may fail or
+    // end the frame and are left to the caller.
+    template <typename Cfg>
+    bool BasicCommand<Cfg>::plainDelimiter(char c) const
+    {
+        if (_np >= Cfg::bufSize)
+        {
+            return false;
+        }
+        switch (_state)
+        {
+        case sDevice:
+            // every one of them ends an address segment
+            return (c == '.' || c == '-' || c == '_' || c == ':' || c == '/' || c == '#') && _ni < Cfg::segments;
+        case sComponent:
+            return c == '/' || c == '#';
+        case sId:
+            return c == '/';
+        case sAction:
+            return c == '?' || (c == '/' && _pc != '/');
+        case sParamKey:
+            return c == '=';
+        case sParamValue:
+            return c == '&' && _params.count() < Cfg::maxParams;
+        }
+        return false;
+    }
+
+    template <typename Cfg>
+    const char *BasicCommand<Cfg>::processRun(const char *p, const char *e)
+    {
+        // only characters which return `Next` are consumed here, the rest
+        // goes through doProcess
+        if (_state == sBegin)
+        {
+            return scan::skipSpace(p, e);
+        }
+        else if (Cfg::binary && _state == sBinary)
+        {
+            return binaryRun(p, e);
+        }
+        else if (Cfg::escape && _pc == '\\')
+        {
+            return p;
+        }
+
+        const char *q;
+        if (Cfg::responses && _state == sEnd)
+        {
+            q = scan::findResponseEnd(p, e);
+            if (q != p)
+            {
+                _pc = q[-1];
+            }
+            return q;
+        }
+        if (_state == sSkip)
+        {
+            // Only `$` ends a skipped frame as a rule, where it is in the frame is worked
+            // out (skipRun) just for a start marker and at the chunk end
+            q = scan::findSkipStop(p, e);
+            while (q != e && *q == '\\' && (!Cfg::escape || e - q > 1))
+            {
+                q = scan::findSkipStop(q + (Cfg::escape ? 2 : 1), e);
+            }
+            if (q == e || *q != '$')
+            {
+                skipRun(p, q);
+            }
+            return q;
+        }
+
+        // text fields, and the delimiters which can neither fail nor end the frame,
+        // until the first byte which can
+        const char *end = e;
+        while (true)
+        {
+            // a full buffer is reported by doProcess, textRun() stores a byte per byte
+            if (_np >= Cfg::bufSize)
+            {
+                return p;
+            }
+            e = end;
+            if ((size_t)(e - p) > (size_t)(Cfg::bufSize - _np))
+            {
+                e = p + (Cfg::bufSize - _np);
+            }
+            p = textRun(p, e);
+#if USC_STATS
+            // the counters are kept per state, process() takes the delimiter
+            return p;
+#endif
+            if (p == end || !plainDelimiter(*p))
+            {
+                return p;
+            }
+            doProcess(*p++);
+        }
+    }
+
+    // The bytes of a text frame which doProcess would take without a result, with the
+    // state in locals: digits up to the limit of their field, action and key characters,
+    // values and the delimiters of the action and the params. Stops in front of any other
+    // byte, the rest of the header included.
+    template <typename Cfg>
+    const char *BasicCommand<Cfg>::textRun(const char *p, const char *e)
+    {
+        // with stats a run stays in one state
+        const bool fuse = !USC_STATS;
+        const char *s = p;
+        char *d = _data;
+        int np = _np;
+        uint8_t state = _state;
+        uint32_t h = Cfg::routing ? _hash : 0;
+
+        while (p != e)
+        {
+            if (state == sParamValue)
+            {
+                while (p != e && !scan::is(*p, scan::cValueEnd))
+                {
+                    d[np++] = *p++;
+                }
+                if (p == e || !fuse || *p != '&' || _params.count() >= Cfg::maxParams)
+                {
+                    break;
+                }
+                p++;
+                d[np++] = 0;
+                _params.endValue(np - 1);
+                _params.nextKey(np);
+                state = sParamKey;
+            }
+            else if (state == sParamKey)
+            {
+                while (p != e && scan::is(*p, scan::cKey))
+                {
+                    d[np++] = *p++;
+                }
+                if (p == e || !fuse || *p != '=')
+                {
+                    break;
+                }
+                p++;
+                d[np++] = 0;
+                _params.addValue(np - 1);
+                state = sParamValue;
+            }
+            else if (state == sAction)
+            {
+                char pc = p != s ? p[-1] : _pc;
+                for (; p != e; p++)
+                {
+                    char c = *p;
+                    if (!scan::is(c, scan::cKey) && (c != '/' || pc == '/'))
+                    {
+                        break;
+                    }
+                    d[np++] = c;
+                    if (Cfg::routing)
+                    {
+                        h = hashStep(h, c);
+                    }
+                    pc = c;
+                }
+                if (p == e || !fuse || *p != '?')
+                {
+                    break;
+                }
+                p++;
+                d[np++] = 0;
+                _params.begin(d, np);
+                state = sParamKey;
+            }
+            else if (state == sDevice || state == sComponent || state == sId ||
+                     (state == sChecksum && !check::Hex))
+            {
+                // stop in front of the digit which overflows, doProcess reports it and
+                // the delimiter behind the number
+                uint8_t nd = maxDigits(state);
+                uint32_t max = maxValue(state);
+                uint32_t acc = _acc;
+                for (; p != e && scan::is(*p, scan::cDigit) && _nd < nd; p++)
+                {
+                    uint32_t v = acc * 10 + (uint8_t)(*p - '0');
+                    if (v > max)
+                    {
+                        break;
+                    }
+                    acc = v;
+                    _nd++;
+                    d[np++] = *p;
+                }
+                _acc = acc;
+                break;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (p != s)
+        {
+            // every byte counts, the checksum digits themselves are never fused with others
+            if (Cfg::checksum && _state != sChecksum)
+            {
+                _checksum = check::update(_checksum, s, p - s);
+            }
+            d[np] = 0;
+            _np = np;
+            _state = state;
+            if (Cfg::routing)
+            {
+                _hash = h;
+            }
+            _pc = p[-1];
+        }
+        return p;
+    }
+
+    // Bytes of a binary frame which can neither fail nor end it, the rest goes through
+    // doProcess. The buffer keeps room for the longest field written per byte.
+    template <typename Cfg>
+    const char *BasicCommand<Cfg>::binaryRun(const char *p, const char *e)
+    {
+        if (_binPhase == bSkip || _binPhase == bDiscard)
+        {
+            size_t n = e - p;
+            if (n > _binLeft)
+            {
+                n = _binLeft;
+            }
+            _binLeft -= n;
+            if (_binPhase == bDiscard)
+            {
+                _discarded += n;
+#if USC_STATS
+                _stats.discarded += n;
+#endif
+            }
+            return p + n;
+        }
+
+        while (p != e && _binLeft > 1 && _np + 8 < Cfg::bufSize)
+        {
+            bool field = _binPhase == bAction || _binPhase == bKey || _binPhase == bValue;
+            if (field && _nd > 1)
+            {
+                // a run inside the field, its last byte changes the phase
+                size_t n = e - p;
+                size_t k = (_nd < _binLeft ? _nd : _binLeft) - 1;
+                if (n > k)
+                {
+                    n = k;
+                }
+                if (n > (size_t)(Cfg::bufSize - 8 - _np))
+                {
+                    n = Cfg::bufSize - 8 - _np;
+                }
+                const char *q = _binPhase == bValue ? p + n : scan::skipKey(p, p + n);
+                n = q - p;
+                if (n != 0)
+                {
+                    memcpy(_data + _np, p, n);
+                    _checksum = check::update(_checksum, p, n);
+                    if (Cfg::routing && _binPhase == bAction)
+                    {
+                        uint32_t h = _hash;
+                        for (size_t i = 0; i < n; i++)
+                        {
+                            h = hashStep(h, p[i]);
+                        }
+                        _hash = h;
+                    }
+                    if (_binPhase == bAction)
+                    {
+                        _pc = q[-1];
+                    }
+                    _np += n;
+                    _data[_np] = 0;
+                    _nd -= n;
+                    _binLeft -= n;
+                    p = q;
+                    continue;
+                }
+            }
+
+            bool safe;
+            switch (_binPhase)
+            {
+            case bAddress:
+            case bComponent:
+            case bId:
+            case bActionLength:
+            case bValueLength:
+            case bValue:
+                safe = true;
+                break;
+            case bKeyLength:
+                safe = _params.count() < Cfg::maxParams;
+                break;
+            case bAction:
+            case bKey:
+                safe = isValidKey(*p);
+                break;
+            default:
+                safe = false;
+                break;
+            }
+            if (!safe)
+            {
+                break;
+            }
+            _checksum = check::step(_checksum, *p);
+            _binLeft--;
+            binaryField(*p++);
+        }
+        return p;
+    }
+
+    // Unlike process(char), a broken frame or garbage between frames is skipped up to
+    // the next `!`, `@` or STX and reported once, with discarded() bytes, when the span ends.
+    template <typename Cfg>
+    size_t BasicCommand<Cfg>::process(const char *buf, size_t n, Result &res)
+    {
+        const char *p = buf;
+        const char *e = buf + n;
+
+        res = Next;
+        while (p != e)
+        {
+            if (_state == sError)
+            {
+#if USC_STATS
+                uint32_t t0 = USC_STATS_CLOCK();
+#endif
+                const char *q = scan::findStart(p, e);
+#if USC_STATS
+                count(sError, q - p, t0);
+                _stats.discarded += q - p;
+#endif
+                _discarded += q - p;
+                p = q;
+                if (p == e)
+                {
+                    break;
+                }
+
+                // the frame data stays readable until the next frame starts
+                res = (Result)_error;
+                _state = sBegin;
+                if (Cfg::callbacks && errCb)
+                {
+                    _params.begin();
+                    errCb(res, *this);
+                }
+                break;
+            }
+
+#if USC_STATS
+            uint8_t st = _state;
+            uint32_t t0 = USC_STATS_CLOCK();
+            const char *q = processRun(p, e);
+            count(st, q - p, t0);
+            p = q;
+#else
+            p = processRun(p, e);
+#endif
+            if (p == e)
+            {
+                break;
+            }
+            char c = *p++;
+#if USC_STATS
+            st = _state;
+            t0 = USC_STATS_CLOCK();
+            res = doProcess(c);
+            count(st, 1, t0);
+#else
+            res = doProcess(c);
+#endif
+            if (res == OK)
+            {
+                res = notify();
+#if USC_STATS
+                countResult(res);
+#endif
+                break;
+            }
+#if USC_STATS
+            countResult(res);
+#endif
+            if (res != Next)
+            {
+                // a start marker ends the broken frame and is parsed again, the rest of a
+                // binary frame with a valid header is passed over by its length instead
+                // and a checksum byte is never a start marker
+                _error = res;
+                _discarded = 1;
+                if (Cfg::binary && _state == sBinary && _binPhase > bFlags)
+                {
+                    _binPhase = bDiscard;
+                    _nd = 0;
+                }
+                else
+                {
+                    bool start = c == '!' || (Cfg::responses && c == '@') || (Cfg::binary && c == USC_BINARY_START);
+                    if (start && !(Cfg::binary && _binPhase == bChecksum))
+                    {
+                        _discarded = 0;
+                        p--;
+                    }
+                    _state = sError;
+                }
+#if USC_STATS
+                _stats.discarded += _discarded;
+#endif
+                res = Next;
+            }
+        }
+        return p - buf;
+    }
+
+    template <typename Cfg>
+    uint32_t BasicCommand<Cfg>::discarded(void) const
+    {
+        return _discarded;
+    }
+
+#if USC_STATS
+    template <typename Cfg>
+    const BasicStats<Cfg::bufSize> &BasicCommand<Cfg>::stats(void) const
+    {
+        return _stats;
+    }
+    template <typename Cfg>
+    void BasicCommand<Cfg>::resetStats(void)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    template <typename Cfg>
+    void BasicCommand<Cfg>::count(uint8_t state, size_t n, uint32_t t0)
+    {
+        _stats.bytes[state] += n;
+        _stats.cycles[state] += USC_STATS_CLOCK() - t0;
+    }
+    template <typename Cfg>
+    void BasicCommand<Cfg>::countResult(Result res)
+    {
+        if (res == OK)
+        {
+            if (isResponse())
+            {
+                _stats.responses++;
+            }
+            else
+            {
+                _stats.frames++;
+                int b = _np / USC_STATS_BUCKET;
+                _stats.lengths[b < _stats.Buckets ? b : _stats.Buckets - 1]++;
+            }
+        }
+        else if (res != Next)
+        {
+            _stats.errors[res]++;
+        }
+    }
+
+#endif
+
+    // Segment boundaries of a completed action, found once per frame so that streams of
+    // a CommandPool keep no extra state while a frame is open.
+    template <typename Cfg>
+    void BasicCommand<Cfg>::splitAction(void)
+    {
+        _ns = 0;
+        if (!hasAction())
+        {
+            return;
+        }
+        const char *p = _action;
+        while (true)
+        {
+            const char *q = _ns + 1 < USC_MAXSEGMENTS ? strchr(p, '/') : nullptr;
+            size_t n = q ? q - p : strlen(p);
+            _segs[_ns] = p - _data;
+            _segLen[_ns] = n;
+            _segIds[_ns] = _vocab ? internSegment(_vocab, p, n) : (uint8_t)UnknownSegment;
+            _ns++;
+            if (q == nullptr)
+            {
+                return;
+            }
+            p = q + 1;
+        }
+    }
+
+    // OK, or Invalid when the schema of its route rejected the frame
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::notify(void)
+    {
+        if (Cfg::routing)
+        {
+            splitAction();
+        }
+
+        // match address
+        bool call = !isResponse() && matchAddress();
+        if (Cfg::routing && call && _dispatcher)
+        {
+            // a frame rejected by the schema of its route goes to the error callback
+            _params.begin();
+            Result res = dispatchCommand(_dispatcher, *this);
+            if (Cfg::callbacks && res == Invalid && errCb)
+            {
+                _params.begin();
+                errCb(res, *this);
+            }
+            if (res == Invalid)
+            {
+                return res;
+            }
+            call = res == Next;
+        }
+        if (Cfg::callbacks && call && cmdCb)
+        {
+            _params.begin();
+            cmdCb(isBroadcast(), _component, action(), _params);
+        }
+        return OK;
+    }
+
+    template <typename Cfg>
+    Result BasicCommand<Cfg>::process(char c) {
+        if (_state == sError) {
+            clear();
+        }
+
+#if USC_STATS
+        uint8_t st = _state;
+        uint32_t t0 = USC_STATS_CLOCK();
+        Result res = doProcess(c);
+        count(st, 1, t0);
+        if (res != OK && res != Next && st == sBegin) {
+            _stats.discarded++;
+        }
+#else
+        Result res = doProcess(c);
+#endif
+        switch (res) {
+        case OK:
+            res = notify();
+            break;
+        case Next:
+            break;
+        default:
+            if (Cfg::callbacks && errCb) {
+                _params.begin();
+                errCb(res, *this);
+            }
+            _state = sError;
+            break;
+        }
+#if USC_STATS
+        countResult(res);
+#endif
+        return res;
+    }
+};
+
+#endif
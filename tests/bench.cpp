@@ -0,0 +1,409 @@
+// Throughput and per frame latency of the parsers over synthetic frame corpora.
+//
+//   bench [--json] [--out file] [--filter text] [--min-time seconds] [--size bytes]
+//
+// The console table is meant for reading. --json prints, and --out writes, one
+// record per parser/corpus pair, which can be kept per commit and compared.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "../src/USCommand.h"
+#include "../src/USCView.h"
+#include "../src/USCPool.h"
+#include "../src/USCWriter.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// frames of a corpus, a frame starts where the previous one ended so garbage in
+// front of a frame is counted as part of it
+struct Corpus {
+    const char *name;
+    std::string data;
+    std::vector<size_t> ends;
+    size_t frames;
+    bool binary;
+};
+
+struct Report {
+    std::string name;
+    size_t bytes;
+    size_t frames;
+    size_t iterations;
+    double seconds;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+static uint32_t seed = 12345;
+static uint32_t rnd(uint32_t n) {
+    seed = seed * 1103515245UL + 12345UL;
+    return (seed >> 8) % n;
+}
+
+static void randomWord(char *buf, size_t n) {
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = chars[rnd(sizeof(chars) - 1)];
+    }
+    buf[n] = 0;
+}
+
+static void addFrame(Corpus &c, const usc::FrameEncoder &enc) {
+    c.data.append(enc.data(), enc.length());
+    c.ends.push_back(c.data.size());
+    c.frames++;
+}
+
+// short pings: !1$
+static void genPing(Corpus &c, usc::CommandEncoder &enc) {
+    enc.clear();
+    enc.begin().device(1 + rnd(9)).end(false);
+    addFrame(c, enc);
+}
+
+// four segment addresses and long actions
+static void genDeep(Corpus &c, usc::CommandEncoder &enc) {
+    char word[24];
+    enc.clear();
+    enc.begin().device(rnd(16)).device(rnd(16)).device(rnd(16)).device(rnd(16)).component(rnd(65535));
+    for (int i = 0; i < 4; i++) {
+        randomWord(word, 8 + rnd(12));
+        enc.action(word);
+    }
+    enc.end(false);
+    addFrame(c, enc);
+}
+
+// as many params as a command can hold, part of the values need escapes
+static void genParams(Corpus &c, usc::CommandEncoder &enc) {
+    static const char *values[] = {"on", "a&b", "x=y", "1|2", "line\r\n", "c:\\tmp", "cost$"};
+    char key[8];
+    do {
+        enc.clear();
+        enc.begin().device(1).component(rnd(100)).action("set");
+        for (int i = 0; i < USC_MAXPARAMS; i++) {
+            randomWord(key, 1 + rnd(3));
+            switch (rnd(3)) {
+            case 0:
+                enc.param(key, (long)rnd(100000) - 50000);
+                break;
+            case 1:
+                enc.param(key, values[rnd(sizeof(values) / sizeof(values[0]))]);
+                break;
+            default:
+                enc.param(key, rnd(10000) / 100.0);
+                break;
+            }
+        }
+        enc.end(false);
+    } while (enc.length() >= USC_BUFSIZE);
+    addFrame(c, enc);
+}
+
+// typical frames with a checksum
+static void genChecksum(Corpus &c, usc::CommandEncoder &enc) {
+    enc.clear();
+    enc.begin().device(rnd(4)).device(1 + rnd(9)).component(rnd(1000)).action("write")
+        .param("addr", (long)rnd(256)).param("v", (long)rnd(65536)).end(true);
+    addFrame(c, enc);
+}
+
+// the frames of genChecksum in binary framing
+static void genBinary(Corpus &c, usc::CommandEncoder &enc) {
+    enc.clear();
+    enc.beginBinary().device(rnd(4)).device(1 + rnd(9)).component(rnd(1000)).action("write")
+        .param("addr", (long)rnd(256)).param("v", (long)rnd(65536)).end();
+    addFrame(c, enc);
+}
+
+// checksummed frames with line noise, broken frames and bad checksums in between
+static void genNoisy(Corpus &c, usc::CommandEncoder &enc) {
+    static const char noise[] = "\x01\x7f~#%^*()_+abcXYZ0123456789 \r\n";
+    size_t n = rnd(24);
+    for (size_t i = 0; i < n; i++) {
+        c.data += noise[rnd(sizeof(noise) - 1)];
+    }
+    switch (rnd(8)) {
+    case 0:
+        // cut off by the next frame
+        c.data += "!1:2/wri";
+        break;
+    case 1:
+        c.data += "!1:2/write|99$";
+        break;
+    }
+    genChecksum(c, enc);
+}
+
+static void build(Corpus &c, const char *name, void (*gen)(Corpus &, usc::CommandEncoder &), size_t size) {
+    char buf[USC_BUFSIZE * 2];
+    usc::CommandEncoder enc(buf, sizeof(buf));
+    c.name = name;
+    c.frames = 0;
+    c.binary = gen == genBinary;
+    c.data.reserve(size + sizeof(buf));
+    while (c.data.size() < size) {
+        gen(c, enc);
+    }
+}
+
+// parsers under test, feed() returns the number of completed frames and Passes is
+// how often it parses its input
+struct CharParser {
+    enum { Passes = 1 };
+    usc::Command cmd;
+    size_t feed(const char *p, size_t n) {
+        size_t nf = 0;
+        for (size_t i = 0; i < n; i++) {
+            nf += cmd.process(p[i]) == usc::OK;
+        }
+        return nf;
+    }
+};
+
+struct BulkParser {
+    enum { Passes = 1 };
+    usc::Command cmd;
+    size_t feed(const char *p, size_t n) {
+        size_t nf = 0;
+        usc::Result res;
+        while (n > 0) {
+            size_t used = cmd.process(p, n, res);
+            p += used;
+            n -= used;
+            nf += res == usc::OK;
+        }
+        return nf;
+    }
+};
+
+// a node on a shared bus, frames for other devices are skipped after the address
+struct SkipParser : BulkParser {
+    SkipParser() {
+        cmd.changeDeviceAddress(0x7FFFFFFF);
+        cmd.setAddressFilter();
+    }
+};
+
+// zero-copy parsing needs whole frames, which is what both runs hand in
+struct ViewParser {
+    enum { Passes = 1 };
+    usc::FrameView view;
+    size_t feed(const char *p, size_t n) {
+        size_t nf = 0;
+        size_t used;
+        while (n > 0) {
+            usc::Result res = view.parse(p, n, used);
+            if (res == usc::Next) {
+                break;
+            }
+            p += used;
+            n -= used;
+            nf += res == usc::OK;
+        }
+        return nf;
+    }
+};
+
+// four streams in chunks of 64 bytes, the same input on each
+struct PoolParser {
+    enum { Passes = 4 };
+    usc::PoolTable<Passes> pool;
+    size_t feed(const char *p, size_t n) {
+        size_t nf = 0;
+        for (size_t i = 0; i < n; i += 64) {
+            size_t k = n - i < 64 ? n - i : 64;
+            for (uint8_t s = 0; s < pool.size(); s++) {
+                nf += pool.process(s, p + i, k);
+            }
+        }
+        return nf;
+    }
+};
+
+static double elapsed(Clock::time_point t0, Clock::time_point t1) {
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+static double percentile(std::vector<double> &v, double q) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t i = (size_t)(q * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+template <typename P>
+static Report run(const char *parser, const Corpus &c, double minTime) {
+    Report r;
+    r.name = std::string(parser) + "/" + c.name;
+    r.bytes = 0;
+    r.frames = 0;
+    r.iterations = 0;
+
+    // throughput: whole corpus per call, until the minimum time has passed
+    P *p = new P();
+    p->feed(c.data.data(), c.data.size());
+    Clock::time_point t0 = Clock::now();
+    Clock::time_point t1;
+    do {
+        r.frames += p->feed(c.data.data(), c.data.size());
+        r.bytes += c.data.size() * P::Passes;
+        r.iterations++;
+        t1 = Clock::now();
+    } while (elapsed(t0, t1) < minTime);
+    r.seconds = elapsed(t0, t1);
+    delete p;
+
+    // latency: one frame per call and pass, minus the cost of reading the clock
+    Clock::time_point c0 = Clock::now();
+    for (int i = 0; i < 1000; i++) {
+        t1 = Clock::now();
+    }
+    double overhead = elapsed(c0, t1) / 1001;
+
+    p = new P();
+    std::vector<double> lat;
+    lat.reserve(c.ends.size());
+    size_t start = 0;
+    for (size_t i = 0; i < c.ends.size(); i++) {
+        size_t end = c.ends[i];
+        t0 = Clock::now();
+        p->feed(c.data.data() + start, end - start);
+        t1 = Clock::now();
+        lat.push_back(std::max(0.0, elapsed(t0, t1) - overhead) * 1e9 / P::Passes);
+        start = end;
+    }
+    delete p;
+
+    std::sort(lat.begin(), lat.end());
+    r.p50 = percentile(lat, 0.50);
+    r.p90 = percentile(lat, 0.90);
+    r.p99 = percentile(lat, 0.99);
+    r.max = lat.empty() ? 0 : lat.back();
+    return r;
+}
+
+static bool selected(const char *parser, const Corpus &c, const char *filter) {
+    return (std::string(parser) + "/" + c.name).find(filter) != std::string::npos;
+}
+
+static void printTable(const std::vector<Report> &results, FILE *f) {
+    fprintf(f, "%-18s %10s %12s %9s %9s %9s %9s\n", "Benchmark", "MB/s", "frames/s", "p50 ns", "p90 ns",
+            "p99 ns", "max ns");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Report &r = results[i];
+        fprintf(f, "%-18s %10.1f %12.0f %9.0f %9.0f %9.0f %9.0f\n", r.name.c_str(), r.bytes / r.seconds / 1e6,
+                r.frames / r.seconds, r.p50, r.p90, r.p99, r.max);
+    }
+}
+
+static void printJson(const std::vector<Report> &results, FILE *f) {
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    fprintf(f, "{\n  \"context\": {\n");
+    fprintf(f, "    \"date\": \"%s\",\n", date);
+    fprintf(f, "    \"bufsize\": %d,\n", USC_BUFSIZE);
+    fprintf(f, "    \"maxparams\": %d,\n", USC_MAXPARAMS);
+    fprintf(f, "    \"table_engine\": %d,\n", USC_TABLE_ENGINE);
+    fprintf(f, "    \"binary\": %d,\n", USC_BINARY);
+    fprintf(f, "    \"stats\": %d\n", USC_STATS);
+    fprintf(f, "  },\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Report &r = results[i];
+        fprintf(f, "    {\n");
+        fprintf(f, "      \"name\": \"%s\",\n", r.name.c_str());
+        fprintf(f, "      \"iterations\": %zu,\n", r.iterations);
+        fprintf(f, "      \"real_time\": %.6f,\n", r.seconds);
+        fprintf(f, "      \"bytes\": %zu,\n", r.bytes);
+        fprintf(f, "      \"frames\": %zu,\n", r.frames);
+        fprintf(f, "      \"bytes_per_second\": %.0f,\n", r.bytes / r.seconds);
+        fprintf(f, "      \"frames_per_second\": %.0f,\n", r.frames / r.seconds);
+        fprintf(f, "      \"latency_ns\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}\n",
+                r.p50, r.p90, r.p99, r.max);
+        fprintf(f, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    const char *out = nullptr;
+    const char *filter = "";
+    double minTime = 0.5;
+    size_t size = 1 << 20;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            minTime = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--json] [--out file] [--filter text] [--min-time s] [--size bytes]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    Corpus corpora[6];
+    build(corpora[0], "ping", genPing, size);
+    build(corpora[1], "deep", genDeep, size);
+    build(corpora[2], "params", genParams, size);
+    build(corpora[3], "checksum", genChecksum, size);
+    build(corpora[4], "noisy", genNoisy, size);
+    build(corpora[5], "binary", genBinary, size);
+
+    std::vector<Report> results;
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        const Corpus &c = corpora[i];
+        // binary frames are parsed only in a USC_BINARY build
+        if (c.binary && !usc::DefaultConfig::binary) {
+            continue;
+        }
+        if (selected("char", c, filter)) {
+            results.push_back(run<CharParser>("char", c, minTime));
+        }
+        if (selected("bulk", c, filter)) {
+            results.push_back(run<BulkParser>("bulk", c, minTime));
+        }
+        if (selected("skip", c, filter)) {
+            results.push_back(run<SkipParser>("skip", c, minTime));
+        }
+        if (selected("view", c, filter) && !c.binary) {
+            results.push_back(run<ViewParser>("view", c, minTime));
+        }
+        if (selected("pool", c, filter)) {
+            results.push_back(run<PoolParser>("pool", c, minTime));
+        }
+    }
+
+    if (json) {
+        printJson(results, stdout);
+    } else {
+        printTable(results, stdout);
+    }
+    if (out != nullptr) {
+        FILE *f = fopen(out, "w");
+        if (f == nullptr) {
+            perror(out);
+            return 1;
+        }
+        printJson(results, f);
+        fclose(f);
+    }
+    return 0;
+}
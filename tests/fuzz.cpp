@@ -0,0 +1,1182 @@
+// Differential fuzzing of the parser against a slow reference parser.
+//
+//   fuzz [file...]                  each file (or stdin) is one input, for AFL and crash repros
+//   fuzz --random n [--seed s]      n generated inputs: encoded frames, cut, mutated and mixed
+//
+// Built with -DUSC_LIBFUZZER=1 the engine, e.g. libFuzzer, provides main() and calls
+// LLVMFuzzerTestOneInput(). Every input goes through Command::process(char), process(buf, n, res)
+// at once and in chunks, two interleaved CommandPool streams and two more configurations.
+// Each must give the results, frames and callbacks the reference gives; the first difference
+// prints both logs and aborts.
+//
+// The reference parses one frame at a time from its start marker by recursive descent and
+// computes checksums bit by bit. It shares no code with the parser.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../src/USCommand.h"
+#include "../src/USCPool.h"
+#include "../src/USCWriter.h"
+
+namespace ref {
+
+struct Config {
+    uint16_t bufSize;
+    uint8_t maxParams;
+    bool checksum;
+    bool escape;
+    bool responses;
+    uint8_t segments;
+    bool binary;
+};
+
+template <typename Cfg>
+static Config configOf() {
+    Config c = {Cfg::bufSize, Cfg::maxParams, Cfg::checksum, Cfg::escape, Cfg::responses, Cfg::segments,
+                Cfg::binary};
+    return c;
+}
+
+struct Param {
+    std::string key;
+    bool hasValue;
+    std::string value;
+};
+
+struct Frame {
+    bool response;
+    uint32_t device;
+    uint16_t component;
+    bool hasId;
+    uint16_t id;
+    bool hasChecksum;
+    std::string action;
+    uint32_t hash;
+    std::vector<std::string> segments;
+    std::vector<Param> params;
+};
+
+// one frame parsed from its start marker: res is OK, an error or Next when the input
+// ends first, pos is the byte which ended or broke the frame and resume is where a bulk
+// parser looks for the next start marker after an error
+struct Outcome {
+    usc::Result res;
+    size_t pos;
+    size_t resume;
+    Frame frame;
+};
+
+static bool isDigit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
+static bool isKey(uint8_t c) {
+    return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '_' || c == '.';
+}
+static bool isSpace(uint8_t c) {
+    return c == ' ' || c == '\r' || c == '\n' || c == '\t';
+}
+static bool isStart(uint8_t c) {
+    return c == '!' || c == '@' || c == 0x02;
+}
+// a start marker which breaks a frame begins the next one
+static bool restarts(const Config &cfg, uint8_t c) {
+    return c == '!' || (c == '@' && cfg.responses) || (c == 0x02 && cfg.binary);
+}
+
+#if USC_CHECKSUM == USC_CHECKSUM_CRC16
+static const int ChecksumBytes = 2;
+static const int ChecksumDigits = 4;
+static const bool ChecksumHex = true;
+static uint32_t checksum(const uint8_t *p, size_t n) {
+    uint16_t c = 0xFFFF;
+    for (size_t i = 0; i < n; i++) {
+        c ^= p[i];
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ 0xA001 : c >> 1;
+        }
+    }
+    return c;
+}
+#elif USC_CHECKSUM == USC_CHECKSUM_CRC8
+static const int ChecksumBytes = 1;
+static const int ChecksumDigits = 2;
+static const bool ChecksumHex = true;
+static uint32_t checksum(const uint8_t *p, size_t n) {
+    uint8_t c = 0;
+    for (size_t i = 0; i < n; i++) {
+        c ^= p[i];
+        for (int k = 0; k < 8; k++) {
+            c = (c & 0x80) ? (uint8_t)((c << 1) ^ 0x07) : (uint8_t)(c << 1);
+        }
+    }
+    return c;
+}
+#else
+static const int ChecksumBytes = 1;
+static const int ChecksumDigits = 3;
+static const bool ChecksumHex = false;
+static uint32_t checksum(const uint8_t *p, size_t n) {
+    uint8_t c = 0;
+    for (size_t i = 0; i < n; i++) {
+        c ^= p[i];
+    }
+    return c;
+}
+#endif
+
+static int digitValue(uint8_t c) {
+    if (isDigit(c)) {
+        return c - '0';
+    }
+    if (ChecksumHex && c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (ChecksumHex && c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static uint32_t fnv(const std::string &s) {
+    uint32_t h = 2166136261UL;
+    for (size_t i = 0; i < s.size(); i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619UL;
+    }
+    return h;
+}
+
+static void finish(Frame &f) {
+    f.hash = fnv(f.action);
+    f.segments.clear();
+    if (f.action.empty()) {
+        return;
+    }
+    size_t p = 0;
+    while (true) {
+        size_t q = f.segments.size() + 1 < USC_MAXSEGMENTS ? f.action.find('/', p) : std::string::npos;
+        f.segments.push_back(f.action.substr(p, q == std::string::npos ? std::string::npos : q - p));
+        if (q == std::string::npos) {
+            return;
+        }
+        p = q + 1;
+    }
+}
+
+static void reset(Frame &f) {
+    f.response = false;
+    f.device = usc::InvalidDevice;
+    f.component = 0;
+    f.hasId = false;
+    f.id = 0;
+    f.hasChecksum = false;
+    f.action.clear();
+    f.hash = fnv(f.action);
+    f.segments.clear();
+    f.params.clear();
+}
+
+// `!...$`: every byte is stored first, a full buffer breaks the frame at any byte
+class TextParser {
+public:
+    TextParser(const Config &cfg, const uint8_t *in, size_t n, size_t start)
+        : _cfg(cfg), _in(in), _n(n), _start(start), _k(start + 1), _stored(1) {
+    }
+
+    Outcome parse() {
+        Outcome o;
+        reset(o.frame);
+        Frame &f = o.frame;
+        o.res = frame(f);
+        o.pos = _k - 1;
+        if (o.res != usc::OK && o.res != usc::Next) {
+            o.resume = restarts(_cfg, _in[o.pos]) ? o.pos : o.pos + 1;
+        }
+        finish(f);
+        return o;
+    }
+
+private:
+    const Config &_cfg;
+    const uint8_t *_in;
+    size_t _n;
+    size_t _start;
+    size_t _k;
+    size_t _stored;
+    usc::Result _err;
+
+    // false at the end of the input or with a full buffer, which sets _err
+    bool take(uint8_t &c) {
+        if (_k >= _n) {
+            _err = usc::Next;
+            return false;
+        }
+        if (_stored >= _cfg.bufSize) {
+            _k++;
+            _err = usc::Overflow;
+            return false;
+        }
+        c = _in[_k++];
+        _stored++;
+        return true;
+    }
+
+    // digits up to the first other byte, which is returned in end; OK when one was found
+    usc::Result number(int maxDigits, uint32_t maxValue, uint32_t &v, uint8_t &end) {
+        v = 0;
+        int nd = 0;
+        while (true) {
+            if (!take(end)) {
+                return _err;
+            }
+            if (!isDigit(end)) {
+                return usc::OK;
+            }
+            if (++nd > maxDigits) {
+                return usc::Unexpected;
+            }
+            v = v * 10 + (end - '0');
+            if (v > maxValue) {
+                return usc::Overflow;
+            }
+        }
+    }
+
+    usc::Result frame(Frame &f) {
+        uint8_t c;
+        uint32_t v;
+        usc::Result res;
+
+        // address segments
+        int segs = 0;
+        f.device = 0;
+        while (true) {
+            if ((res = number(3, 255, v, c)) != usc::OK) {
+                return res;
+            }
+            bool sep = c == '.' || c == '-' || c == '_';
+            if (!sep && c != ':' && c != '/' && c != '|' && c != '$' && c != '#') {
+                return usc::Unexpected;
+            }
+            if (c == '|' && !_cfg.checksum) {
+                return usc::Unexpected;
+            }
+            if (++segs > _cfg.segments) {
+                return usc::Unexpected;
+            }
+            f.device = (f.device << 4) | v;
+            if (!sep) {
+                break;
+            }
+        }
+        if (c == ':') {
+            if ((res = number(5, 65535, v, c)) != usc::OK) {
+                return res;
+            }
+            f.component = (uint16_t)v;
+            if (c != '/' && c != '|' && c != '$' && c != '#') {
+                return usc::Unexpected;
+            }
+            if (c == '|' && !_cfg.checksum) {
+                return usc::Unexpected;
+            }
+        }
+        if (c == '#') {
+            if ((res = number(5, 65535, v, c)) != usc::OK) {
+                return res;
+            }
+            f.hasId = true;
+            f.id = (uint16_t)v;
+            if (c != '/' && c != '|' && c != '$') {
+                return usc::Unexpected;
+            }
+            if (c == '|' && !_cfg.checksum) {
+                return usc::Unexpected;
+            }
+        }
+        if (c == '/') {
+            uint8_t prev = '/';
+            while (true) {
+                if (!take(c)) {
+                    return _err;
+                }
+                if (isKey(c) || (c == '/' && prev != '/')) {
+                    f.action += (char)c;
+                    prev = c;
+                    continue;
+                }
+                if (c == '?' || c == '$' || (c == '|' && _cfg.checksum)) {
+                    break;
+                }
+                return usc::Unexpected;
+            }
+        }
+        if (c == '?') {
+            if ((res = params(f, c)) != usc::OK) {
+                return res;
+            }
+        }
+        if (c == '|') {
+            return check(f);
+        }
+        return usc::OK;
+    }
+
+    usc::Result params(Frame &f, uint8_t &c) {
+        while (true) {
+            Param p;
+            p.hasValue = false;
+            while (true) {
+                if (!take(c)) {
+                    return _err;
+                }
+                if (!isKey(c)) {
+                    break;
+                }
+                p.key += (char)c;
+            }
+            if (c == '$' || (c == '|' && _cfg.checksum)) {
+                f.params.push_back(p);
+                return usc::OK;
+            }
+            if (c != '=') {
+                return usc::Unexpected;
+            }
+
+            p.hasValue = true;
+            while (true) {
+                if (!take(c)) {
+                    return _err;
+                }
+                if (c == '\\' && _cfg.escape) {
+                    if (!take(c)) {
+                        return _err;
+                    }
+                    // the escaped byte replaces the backslash
+                    _stored--;
+                    switch (c) {
+                    case 'r':
+                        p.value += '\r';
+                        break;
+                    case 'n':
+                        p.value += '\n';
+                        break;
+                    case 't':
+                        p.value += '\t';
+                        break;
+                    case 'b':
+                        p.value += '\b';
+                        break;
+                    case '\\':
+                    case '&':
+                    case '$':
+                    case '=':
+                    case '|':
+                        p.value += (char)c;
+                        break;
+                    default:
+                        return usc::Invalid;
+                    }
+                    continue;
+                }
+                if (c == '&' || c == '$' || c == '|') {
+                    break;
+                }
+                p.value += (char)c;
+            }
+            if (c == '|' && !_cfg.checksum) {
+                return usc::Unexpected;
+            }
+            f.params.push_back(p);
+            if (c != '&') {
+                return usc::OK;
+            }
+            if (f.params.size() >= _cfg.maxParams) {
+                return usc::Overflow;
+            }
+        }
+    }
+
+    usc::Result check(Frame &f) {
+        uint32_t expect = checksum(_in + _start, _k - _start);
+        uint32_t v = 0;
+        int nd = 0;
+        uint8_t c;
+        while (true) {
+            if (!take(c)) {
+                return _err;
+            }
+            if (c == '$') {
+                // a CRC has all its digits
+                if (ChecksumHex && nd != ChecksumDigits) {
+                    return usc::Unexpected;
+                }
+                break;
+            }
+            int d = digitValue(c);
+            if (d < 0) {
+                return usc::Unexpected;
+            }
+            if (++nd > ChecksumDigits) {
+                return usc::Unexpected;
+            }
+            v = v * (ChecksumHex ? 16 : 10) + d;
+            if (!ChecksumHex && v > 255) {
+                return usc::Overflow;
+            }
+        }
+        f.hasChecksum = true;
+        return v == expect ? usc::OK : usc::Invalid;
+    }
+};
+
+// STX len fields crc: the fields are checked against len and rebuilt as text, which has
+// to fit the buffer like a text frame
+class BinaryParser {
+public:
+    BinaryParser(const Config &cfg, const uint8_t *in, size_t n, size_t start)
+        : _cfg(cfg), _in(in), _n(n), _start(start) {
+    }
+
+    Outcome parse() {
+        Outcome o;
+        reset(o.frame);
+        Frame &f = o.frame;
+        if (_start + 1 >= _n) {
+            o.res = usc::Next;
+            return o;
+        }
+        size_t len = _in[_start + 1];
+        if (len == 0) {
+            o.res = usc::Unexpected;
+            o.pos = _start + 1;
+            o.resume = o.pos + 1;
+            return o;
+        }
+        _k = _start + 2;
+        _end = _k + len;
+        _text = 1;
+        o.res = fields(f);
+        o.pos = _k - 1;
+        // the rest of a broken frame is passed over by its length, unless its header is
+        if (o.pos == _start + 2) {
+            o.resume = restarts(_cfg, _in[o.pos]) ? o.pos : o.pos + 1;
+        } else {
+            o.resume = _end + ChecksumBytes;
+        }
+        if (o.res == usc::Next && _k == _end) {
+            // the fields are complete, the checksum follows
+            if (_end + ChecksumBytes > _n) {
+                o.res = usc::Next;
+                return o;
+            }
+            uint32_t v = 0;
+            for (int i = 0; i < ChecksumBytes; i++) {
+                v |= (uint32_t)_in[_end + i] << (8 * i);
+            }
+            f.hasChecksum = true;
+            o.pos = _end + ChecksumBytes - 1;
+            o.resume = o.pos + 1;
+            o.res = v == checksum(_in + _start, _end - _start) ? usc::OK : usc::Invalid;
+            finish(f);
+        }
+        return o;
+    }
+
+private:
+    const Config &_cfg;
+    const uint8_t *_in;
+    size_t _n;
+    size_t _start;
+    size_t _k;
+    size_t _end;
+    size_t _text;
+    usc::Result _err;
+
+    bool more() const {
+        return _k < _end;
+    }
+    // false at the end of the fields where more are needed, or of the input, which sets _err
+    bool take(uint8_t &b) {
+        if (_k >= _end) {
+            _err = usc::Unexpected;
+            return false;
+        }
+        if (_k >= _n) {
+            _err = usc::Next;
+            return false;
+        }
+        b = _in[_k++];
+        return true;
+    }
+    bool append(size_t n) {
+        if (_text + n > _cfg.bufSize) {
+            return false;
+        }
+        _text += n;
+        return true;
+    }
+    static size_t digits(uint32_t v) {
+        return v >= 10000 ? 5 : v >= 1000 ? 4 : v >= 100 ? 3 : v >= 10 ? 2 : 1;
+    }
+
+    usc::Result fields(Frame &f) {
+        uint8_t b, lo, hi;
+        if (!take(b)) {
+            return _err;
+        }
+        int segs = b & 0x0F;
+        bool hasComp = (b & 0x10) != 0;
+        bool hasId = (b & 0x20) != 0;
+        if (segs == 0 || segs > _cfg.segments || (b & 0xC0) != 0x80 ||
+            _end - _k < (size_t)(segs + 2 * hasComp + 2 * hasId)) {
+            return usc::Unexpected;
+        }
+
+        f.device = 0;
+        for (int i = 0; i < segs; i++) {
+            if (!take(b)) {
+                return _err;
+            }
+            if (!append((i > 0) + digits(b))) {
+                return usc::Overflow;
+            }
+            f.device = (f.device << 4) | b;
+        }
+        if (hasComp) {
+            if (!take(lo) || !take(hi)) {
+                return _err;
+            }
+            f.component = (uint16_t)(lo | (hi << 8));
+            if (!append(1 + digits(f.component))) {
+                return usc::Overflow;
+            }
+        }
+        if (hasId) {
+            if (!take(lo) || !take(hi)) {
+                return _err;
+            }
+            f.hasId = true;
+            f.id = (uint16_t)(lo | (hi << 8));
+            if (!append(1 + digits(f.id))) {
+                return usc::Overflow;
+            }
+        }
+
+        // the fields may end before the action and before each param
+        if (!more()) {
+            return usc::Next;
+        }
+        uint8_t alen;
+        if (!take(alen)) {
+            return _err;
+        }
+        if (alen > 0) {
+            if (!append(1)) {
+                return usc::Overflow;
+            }
+            uint8_t prev = '/';
+            for (int i = 0; i < alen; i++) {
+                if (!take(b)) {
+                    return _err;
+                }
+                if (!isKey(b) && (b != '/' || prev == '/')) {
+                    return usc::Unexpected;
+                }
+                if (!append(1)) {
+                    return usc::Overflow;
+                }
+                f.action += (char)b;
+                prev = b;
+            }
+        }
+
+        while (more()) {
+            uint8_t klen, vlen;
+            if (!take(klen)) {
+                return _err;
+            }
+            if (f.params.empty() ? !append(1) : f.params.size() >= _cfg.maxParams) {
+                return usc::Overflow;
+            }
+            Param p;
+            for (int i = 0; i < klen; i++) {
+                if (!take(b)) {
+                    return _err;
+                }
+                if (!isKey(b)) {
+                    return usc::Unexpected;
+                }
+                if (!append(1)) {
+                    return usc::Overflow;
+                }
+                p.key += (char)b;
+            }
+            if (!take(vlen)) {
+                return _err;
+            }
+            if (!append(1)) {
+                return usc::Overflow;
+            }
+            p.hasValue = vlen != 0xFF;
+            if (p.hasValue) {
+                for (int i = 0; i < vlen; i++) {
+                    if (!take(b)) {
+                        return _err;
+                    }
+                    if (!append(1)) {
+                        return usc::Overflow;
+                    }
+                    p.value += (char)b;
+                }
+                if (!append(1)) {
+                    return usc::Overflow;
+                }
+            }
+            f.params.push_back(p);
+        }
+        return usc::Next;
+    }
+};
+
+struct Event {
+    enum Kind { Call, Frame, ErrorCall, Error } kind;
+    std::string text;
+};
+
+static std::string describe(const ref::Frame &f) {
+    char head[160];
+    snprintf(head, sizeof(head), "resp=%d dev=%08x comp=%u id=%d:%u chk=%d hash=%08x", f.response, f.device,
+             f.component, f.hasId, f.id, f.hasChecksum, f.hash);
+    std::string s = head;
+    s += " act='" + f.action + "' segs=[";
+    for (size_t i = 0; i < f.segments.size(); i++) {
+        s += (i ? "," : "") + f.segments[i];
+    }
+    s += "] params=[";
+    for (size_t i = 0; i < f.params.size(); i++) {
+        const Param &p = f.params[i];
+        s += (i ? " " : "") + p.key;
+        if (p.hasValue) {
+            s += "=";
+            for (size_t j = 0; j < p.value.size(); j++) {
+                uint8_t c = p.value[j];
+                if (c >= 0x20 && c < 0x7F && c != '\\') {
+                    s += (char)c;
+                } else {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\x%02x", c);
+                    s += esc;
+                }
+            }
+        }
+    }
+    return s + "]";
+}
+
+// a matching frame calls the command callback before process() returns OK
+static void frameEvents(const Frame &f, uint32_t devAddr, std::vector<Event> &ev) {
+    if (!f.response && (f.device == 0 || f.device == devAddr)) {
+        char head[48];
+        snprintf(head, sizeof(head), "call b=%d comp=%u act='", f.device == 0, f.component);
+        Event e = {Event::Call, head + f.action + "'"};
+        ev.push_back(e);
+    }
+    Event e = {Event::Frame, describe(f)};
+    ev.push_back(e);
+}
+
+static void errorEvents(usc::Result res, std::vector<Event> &ev) {
+    char text[16];
+    snprintf(text, sizeof(text), "%d", res);
+    Event e1 = {Event::ErrorCall, text};
+    Event e2 = {Event::Error, text};
+    ev.push_back(e1);
+    ev.push_back(e2);
+}
+
+static Outcome parseAt(const Config &cfg, const uint8_t *in, size_t n, size_t i) {
+    uint8_t c = in[i];
+    if (c == '!') {
+        return TextParser(cfg, in, n, i).parse();
+    }
+    Outcome o;
+    reset(o.frame);
+    o.pos = i;
+    o.resume = i + 1;
+    if (c == 0x02 && cfg.binary) {
+        Outcome b = BinaryParser(cfg, in, n, i).parse();
+        // a header which does not hold up makes the STX noise in front of a frame at len
+        if (b.res == usc::Unexpected && b.pos == i + 2 && (in[i + 1] == '!' || (in[i + 1] == '@' && cfg.responses))) {
+            return parseAt(cfg, in, n, i + 1);
+        }
+        return b;
+    }
+    if (c == '@' && cfg.responses) {
+        // a response is only passed over up to its end marker
+        o.frame.response = true;
+        finish(o.frame);
+        for (size_t k = i + 1; k < n; k++) {
+            if (in[k] == '\\' && cfg.escape) {
+                if (++k >= n) {
+                    break;
+                }
+                if (in[k] == 0 || !strchr("rntb\\&$=|", in[k])) {
+                    o.res = usc::Unexpected;
+                    o.pos = k;
+                    o.resume = restarts(cfg, in[k]) ? k : k + 1;
+                    return o;
+                }
+            } else if (in[k] == '$') {
+                o.res = usc::OK;
+                o.pos = k;
+                return o;
+            }
+        }
+        o.res = usc::Next;
+        return o;
+    }
+    o.res = usc::Unexpected;
+    return o;
+}
+
+// Command::process(char): every error is reported at the byte which caused it and the
+// next byte starts over
+static void perByte(const Config &cfg, const uint8_t *in, size_t n, uint32_t devAddr, std::vector<Event> &ev) {
+    size_t i = 0;
+    while (i < n) {
+        if (isSpace(in[i])) {
+            i++;
+            continue;
+        }
+        Outcome o = parseAt(cfg, in, n, i);
+        if (o.res == usc::Next) {
+            return;
+        }
+        if (o.res == usc::OK) {
+            frameEvents(o.frame, devAddr, ev);
+        } else {
+            errorEvents(o.res, ev);
+        }
+        i = o.pos + 1;
+    }
+}
+
+// Command::process(buf, n, res): an error is reported once the next start marker is found,
+// the bytes in between are dropped
+static void bulk(const Config &cfg, const uint8_t *in, size_t n, uint32_t devAddr, std::vector<Event> &ev) {
+    size_t i = 0;
+    while (i < n) {
+        if (isSpace(in[i])) {
+            i++;
+            continue;
+        }
+        Outcome o = parseAt(cfg, in, n, i);
+        if (o.res == usc::Next) {
+            return;
+        }
+        if (o.res == usc::OK) {
+            frameEvents(o.frame, devAddr, ev);
+            i = o.pos + 1;
+            continue;
+        }
+        i = o.resume;
+        while (i < n && !isStart(in[i])) {
+            i++;
+        }
+        if (i >= n) {
+            return;
+        }
+        errorEvents(o.res, ev);
+    }
+}
+
+};
+
+// logs of the parser under test, filled by the callbacks and after each result
+static std::vector<ref::Event> *current;
+
+template <typename C>
+static ref::Frame frameOf(C &cmd) {
+    ref::Frame f;
+    f.response = cmd.isResponse();
+    f.device = cmd.device();
+    f.component = cmd.component();
+    f.hasId = cmd.hasId();
+    f.id = cmd.id();
+    f.hasChecksum = cmd.hasChecksum();
+    f.action = cmd.action();
+    f.hash = cmd.actionHash();
+    for (uint8_t i = 0; i < cmd.actionSegments(); i++) {
+        f.segments.push_back(std::string(cmd.segment(i), cmd.segmentLength(i)));
+    }
+    for (int i = 0; i < cmd.params().count(); i++) {
+        usc::KeyVal kv = cmd.params()[i];
+        ref::Param p;
+        p.key.assign(kv.key(), kv.keyLength());
+        p.hasValue = kv.hasValue();
+        if (p.hasValue) {
+            p.value.assign(kv.value(), kv.valueLength());
+        }
+        f.params.push_back(p);
+    }
+    return f;
+}
+
+template <typename C>
+static void logResult(usc::Result res, C &cmd) {
+    if (res == usc::OK) {
+        ref::Event e = {ref::Event::Frame, ref::describe(frameOf(cmd))};
+        current->push_back(e);
+    } else if (res != usc::Next) {
+        char text[16];
+        snprintf(text, sizeof(text), "%d", res);
+        ref::Event e = {ref::Event::Error, text};
+        current->push_back(e);
+    }
+}
+
+template <typename P>
+static void onCommand(bool broadcast, uint16_t comp, const char *action, P &) {
+    char head[48];
+    snprintf(head, sizeof(head), "call b=%d comp=%u act='", broadcast, comp);
+    ref::Event e = {ref::Event::Call, head + std::string(action) + "'"};
+    current->push_back(e);
+}
+
+template <typename C>
+static void onError(usc::Result res, C &) {
+    char text[16];
+    snprintf(text, sizeof(text), "%d", res);
+    ref::Event e = {ref::Event::ErrorCall, text};
+    current->push_back(e);
+}
+
+static const uint32_t DevAddr = 1;
+
+// chunk sizes of 1 to 17 bytes, from a seed taken from the input
+struct Chunks {
+    uint32_t seed;
+    explicit Chunks(const uint8_t *in, size_t n) : seed(2166136261UL) {
+        for (size_t i = 0; i < n; i++) {
+            seed = (seed ^ in[i]) * 16777619UL;
+        }
+    }
+    size_t next(size_t left) {
+        seed = seed * 1103515245UL + 12345UL;
+        size_t k = 1 + (seed >> 16) % 17;
+        return k < left ? k : left;
+    }
+};
+
+template <typename C>
+static void runPerByte(C &cmd, const uint8_t *in, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        logResult(cmd.process((char)in[i]), cmd);
+    }
+}
+
+// false when the parser stops moving forward
+template <typename C>
+static bool runBulk(C &cmd, const uint8_t *in, size_t n, bool chunked) {
+    Chunks chunks(in, n);
+    size_t i = 0;
+    while (i < n) {
+        size_t end = chunked ? i + chunks.next(n - i) : n;
+        int stuck = 0;
+        while (i < end) {
+            usc::Result res;
+            size_t used = cmd.process((const char *)in + i, end - i, res);
+            logResult(res, cmd);
+            i += used;
+            stuck = used == 0 ? stuck + 1 : 0;
+            if (stuck > 2) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static std::vector<ref::Event> withoutCalls(const std::vector<ref::Event> &ev) {
+    std::vector<ref::Event> out;
+    for (size_t i = 0; i < ev.size(); i++) {
+        if (ev[i].kind == ref::Event::Frame || ev[i].kind == ref::Event::Error) {
+            out.push_back(ev[i]);
+        }
+    }
+    return out;
+}
+
+static void printInput(const uint8_t *in, size_t n) {
+    fprintf(stderr, "input (%zu bytes): \"", n);
+    for (size_t i = 0; i < n; i++) {
+        uint8_t c = in[i];
+        if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+            fputc(c, stderr);
+        } else {
+            fprintf(stderr, "\\x%02x", c);
+        }
+    }
+    fprintf(stderr, "\"\n");
+}
+
+static void compare(const char *path, const std::vector<ref::Event> &want, const std::vector<ref::Event> &got,
+                    bool progress, const uint8_t *in, size_t n) {
+    size_t i = 0;
+    while (i < want.size() && i < got.size() && want[i].text == got[i].text && want[i].kind == got[i].kind) {
+        i++;
+    }
+    if (progress && i == want.size() && i == got.size()) {
+        return;
+    }
+    fprintf(stderr, "\n%s differs from the reference at event %zu%s\n", path, i, progress ? "" : ", no progress");
+    printInput(in, n);
+    static const char *kinds[] = {"call", "frame", "errcb", "error"};
+    for (size_t k = i > 3 ? i - 3 : 0; k < want.size() || k < got.size(); k++) {
+        if (k < want.size()) {
+            fprintf(stderr, "  ref %3zu %-5s %s\n", k, kinds[want[k].kind], want[k].text.c_str());
+        }
+        if (k < got.size()) {
+            fprintf(stderr, "  got %3zu %-5s %s\n", k, kinds[got[k].kind], got[k].text.c_str());
+        }
+    }
+    abort();
+}
+
+template <typename Cfg>
+static void checkConfig(const char *name, const uint8_t *in, size_t n, bool whole) {
+    typedef usc::BasicCommand<Cfg> C;
+    ref::Config cfg = ref::configOf<Cfg>();
+    std::vector<ref::Event> byteRef, bulkRef, got;
+    ref::perByte(cfg, in, n, DevAddr, byteRef);
+    ref::bulk(cfg, in, n, DevAddr, bulkRef);
+    current = &got;
+    std::string path;
+
+    C *cmd = new C(DevAddr);
+    cmd->attachCallback(onCommand<usc::BasicParams<Cfg> >, onError<C>);
+    runPerByte(*cmd, in, n);
+    compare((path = std::string(name) + " process(char)").c_str(), byteRef, got, true, in, n);
+    delete cmd;
+
+    for (int chunked = whole ? 0 : 1; chunked < 2; chunked++) {
+        got.clear();
+        cmd = new C(DevAddr);
+        cmd->attachCallback(onCommand<usc::BasicParams<Cfg> >, onError<C>);
+        bool progress = runBulk(*cmd, in, n, chunked);
+        path = std::string(name) + (chunked ? " process(buf) in chunks" : " process(buf)");
+        compare(path.c_str(), bulkRef, got, progress, in, n);
+        delete cmd;
+    }
+}
+
+// the input on stream 0 and the input reversed on stream 1, chunk by chunk in turn
+static void checkPool(const uint8_t *in, size_t n) {
+    ref::Config cfg = ref::configOf<usc::DefaultConfig>();
+    std::vector<uint8_t> rev(in, in + n);
+    for (size_t i = 0; i < n / 2; i++) {
+        std::swap(rev[i], rev[n - 1 - i]);
+    }
+    const uint8_t *inputs[2] = {in, rev.data()};
+    std::vector<ref::Event> want[2], got[2];
+    size_t pos[2] = {0, 0};
+    for (int s = 0; s < 2; s++) {
+        ref::bulk(cfg, inputs[s], n, DevAddr, want[s]);
+        want[s] = withoutCalls(want[s]);
+    }
+
+    usc::PoolTable<2> *pool = new usc::PoolTable<2>();
+    Chunks chunks(in, n);
+    int stuck[2] = {0, 0};
+    while ((pos[0] < n || pos[1] < n) && stuck[0] <= 2 && stuck[1] <= 2) {
+        for (uint8_t s = 0; s < 2; s++) {
+            if (pos[s] >= n) {
+                continue;
+            }
+            current = &got[s];
+            size_t k = chunks.next(n - pos[s]);
+            usc::Result res;
+            size_t used = pool->process(s, (const char *)inputs[s] + pos[s], k, res);
+            logResult(res, pool->command());
+            pos[s] += used;
+            stuck[s] = used == 0 ? stuck[s] + 1 : 0;
+        }
+    }
+    compare("pool stream 0", want[0], got[0], stuck[0] <= 2, in, n);
+    compare("pool stream 1", want[1], got[1], stuck[1] <= 2, rev.data(), n);
+    delete pool;
+}
+
+// a small buffer with two params and two address segments, and every feature disabled
+typedef usc::CommandConfig<32, 2, true, true, true, 2, true> SmallConfig;
+typedef usc::CommandConfig<64, 4, false, false, false, 1, false> PlainConfig;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    checkConfig<usc::DefaultConfig>("default", data, size, true);
+    checkPool(data, size);
+    checkConfig<SmallConfig>("small", data, size, false);
+    checkConfig<PlainConfig>("plain", data, size, false);
+    return 0;
+}
+
+#if !USC_LIBFUZZER
+static uint32_t seed = 1;
+static uint32_t rnd(uint32_t n) {
+    seed = seed * 1103515245UL + 12345UL;
+    return (seed >> 8) % n;
+}
+
+static void randomWord(char *buf, size_t n, const char *chars) {
+    size_t k = strlen(chars);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = chars[rnd(k)];
+    }
+    buf[n] = 0;
+}
+
+// a valid frame, text or binary, command or response
+static void genFrame(std::string &out) {
+    char buf[512];
+    char word[32];
+    usc::CommandEncoder cmd(buf, sizeof(buf));
+    usc::ResponseWriter resp(buf, sizeof(buf));
+    int kind = rnd(8);
+    usc::FrameEncoder &enc = kind == 0 ? resp.begin() : kind == 1 ? cmd.beginBinary() : cmd.begin();
+    int segs = 1 + rnd(4);
+    for (int i = 0; i < segs; i++) {
+        enc.device(rnd(3) == 0 ? rnd(256) : rnd(3));
+    }
+    if (rnd(2)) {
+        enc.component(rnd(3) == 0 ? rnd(65536) : rnd(10));
+    }
+    if (rnd(3) == 0) {
+        enc.id(rnd(65536));
+    }
+    int nseg = rnd(4);
+    for (int i = 0; i < nseg; i++) {
+        randomWord(word, 1 + rnd(6), "abcxyz019._-");
+        enc.action(word);
+    }
+    int np = rnd(5);
+    for (int i = 0; i < np; i++) {
+        randomWord(word, rnd(4), "kvab19_");
+        switch (rnd(4)) {
+        case 0:
+            enc.param(word);
+            break;
+        case 1:
+            enc.param(word, (long)rnd(100000) - 50000);
+            break;
+        default: {
+            char value[16];
+            randomWord(value, rnd(10), "ab01 =&$|\\\r\n\t!@#?/:");
+            enc.param(word, value);
+            break;
+        }
+        }
+    }
+    enc.end(rnd(3) != 0);
+    out.append(enc.data(), enc.length());
+}
+
+static void mutate(std::string &s) {
+    static const char bytes[] = "!@\x02$|&=?/:#.\\ \r\n0123456789abcfF_-\xff";
+    int n = rnd(4);
+    for (int i = 0; i < n && !s.empty(); i++) {
+        size_t at = rnd(s.size());
+        switch (rnd(5)) {
+        case 0:
+            s[at] = bytes[rnd(sizeof(bytes) - 1)];
+            break;
+        case 1:
+            s.insert(at, 1, bytes[rnd(sizeof(bytes) - 1)]);
+            break;
+        case 2:
+            s.erase(at, 1);
+            break;
+        case 3:
+            s[at] ^= (char)(1 << rnd(8));
+            break;
+        default:
+            s.insert(at, s.substr(rnd(s.size()), rnd(24)));
+            break;
+        }
+    }
+}
+
+static void runOne(const std::string &s) {
+    LLVMFuzzerTestOneInput((const uint8_t *)s.data(), s.size());
+}
+
+int main(int argc, char **argv) {
+    long random = -1;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--random") == 0 && i + 1 < argc) {
+            random = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-') {
+            files.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "usage: %s [file...] | --random n [--seed s]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (random >= 0) {
+        for (long i = 0; i < random; i++) {
+            std::string s;
+            int frames = 1 + rnd(6);
+            for (int k = 0; k < frames; k++) {
+                if (rnd(4) == 0) {
+                    char junk[4];
+                    randomWord(junk, 1 + rnd(3), " x\r\n$!0");
+                    s += junk;
+                }
+                std::string f;
+                genFrame(f);
+                if (rnd(2)) {
+                    mutate(f);
+                }
+                if (rnd(6) == 0) {
+                    f.resize(rnd(f.size() + 1));
+                }
+                s += f;
+            }
+            runOne(s);
+        }
+        printf("%ld inputs, no differences\n", random);
+        return 0;
+    }
+
+    if (files.empty()) {
+        std::string s;
+        int c;
+        while ((c = getchar()) != EOF) {
+            s += (char)c;
+        }
+        runOne(s);
+        return 0;
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+        FILE *f = fopen(files[i], "rb");
+        if (f == nullptr) {
+            perror(files[i]);
+            return 1;
+        }
+        std::string s;
+        char buf[4096];
+        size_t k;
+        while ((k = fread(buf, 1, sizeof(buf), f)) > 0) {
+            s.append(buf, k);
+        }
+        fclose(f);
+        runOne(s);
+    }
+    printf("%zu inputs, no differences\n", files.size());
+    return 0;
+}
+#endif
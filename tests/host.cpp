@@ -0,0 +1,349 @@
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <pty.h>
+#include <unistd.h>
+#include "../src/USCommand.h"
+#include "../src/USCPool.h"
+#include "../host/USCRing.h"
+#include "../host/USCEngine.h"
+#include "../host/USCGateway.h"
+#include "../host/USCPending.h"
+#include "../host/USCCapture.h"
+#include "../src/USCView.h"
+#include "../src/USCWriter.h"
+
+static const uint8_t Streams = 8;
+static std::atomic<uint64_t> frames[Streams];
+static std::atomic<uint64_t> params;
+
+void onPacket(usc::Packet &pkt) {
+    frames[pkt.stream()]++;
+    usc::Params &pars = pkt.params();
+    while (pars.next())
+    {
+        params += pars.kv().valueInt();
+    }
+}
+
+void testRing() {
+    usc::SpscRing<int, 64> *ring = new usc::SpscRing<int, 64>();
+    const int n = 100000;
+    long sum = 0;
+    std::thread producer([ring]() {
+        for (int i = 1; i <= n; i++)
+        {
+            while (!ring->push(i))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for (int i = 0; i < n; i++)
+    {
+        int v;
+        while (!ring->pop(v))
+        {
+            std::this_thread::yield();
+        }
+        sum += v;
+    }
+    producer.join();
+    printf("SPSC sum: %ld (%ld)\n", sum, (long)n * (n + 1) / 2);
+    delete ring;
+}
+
+void testEngine() {
+    std::ifstream file("input.txt");
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // reference: frames and param values of one pass on a single Command
+    usc::Command cmd;
+    uint64_t expFrames = 0, expParams = 0;
+    const char *p = input.data();
+    size_t n = input.size();
+    while (n > 0)
+    {
+        usc::Result res;
+        size_t used = cmd.process(p, n, res);
+        p += used;
+        n -= used;
+        if (res == usc::OK)
+        {
+            expFrames++;
+            usc::Params &pars = cmd.params().begin();
+            while (pars.next())
+            {
+                expParams += pars.kv().valueInt();
+            }
+        }
+    }
+
+    usc::Engine engine(onPacket, 3);
+    usc::PoolTable<Streams> *pool = new usc::PoolTable<Streams>();
+    usc::Feeder feeder(engine, *pool);
+    engine.start();
+
+    // the same input on every stream, stream 0 is four times as busy
+    const int rounds = 100;
+    const size_t chunk = 9;
+    uint64_t posted = 0, passes = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        uint8_t active = r % 4 == 0 ? Streams : 1;
+        for (size_t i = 0; i < input.size(); i += chunk)
+        {
+            size_t k = input.size() - i < chunk ? input.size() - i : chunk;
+            for (uint8_t s = 0; s < active; s++)
+            {
+                posted += feeder.process(s, input.data() + i, k);
+            }
+        }
+        passes += active;
+
+        // let the workers catch up so no packet is dropped
+        while (engine.handled() < posted)
+        {
+            std::this_thread::yield();
+        }
+    }
+    engine.stop();
+    delete pool;
+
+    uint64_t total = 0;
+    for (uint8_t s = 0; s < Streams; s++)
+    {
+        total += frames[s];
+    }
+    printf("Workers: %u, frames: %llu (%llu), params: %llu (%llu), dropped: %llu\n", engine.workers(),
+           (unsigned long long)total, (unsigned long long)(expFrames * passes),
+           (unsigned long long)params, (unsigned long long)(expParams * passes),
+           (unsigned long long)feeder.dropped());
+    printf("Stream 0: %llu, stream 1: %llu\n", (unsigned long long)frames[0], (unsigned long long)frames[1]);
+}
+
+void onPort(usc::Gateway &gw, int port, usc::Command &cmd) {
+    char resp[64];
+    snprintf(resp, sizeof(resp), "%d:%d/%s", port, cmd.component(), cmd.action());
+    gw.respond(port, resp);
+}
+
+void onPortError(usc::Gateway &gw, int port, usc::Result, usc::Command &) {
+    gw.respond(port, "err");
+}
+
+void testGateway(usc::Gateway::Backend backend) {
+    // the gateway reads the pty slaves like serial adapters, the masters are the buses
+    const int ports = 2;
+    int master[ports];
+    usc::Gateway gw(ports, backend);
+    gw.attachCallback(onPort, onPortError);
+    for (int i = 0; i < ports; i++)
+    {
+        int slave;
+        char name[64];
+        openpty(&master[i], &slave, name, NULL, NULL);
+        ::close(slave);
+        gw.open(name, 18);
+    }
+    // port 1 also serves the group 0.0.9.*
+    gw.command(1).setAddressFilter("0.0.9.*", false);
+    printf("Backend: %s\n", gw.backend() == usc::Gateway::IoUring ? "io_uring" : "epoll");
+
+    const char *bus[ports] = {"!0.0.1.2:100/test?a=1$ !0.0.1.2:7/x$", "!1:1/a$!0.0.1.2/b$ x!0.0.1.2:5/c$!0.0.9.4:2/d$"};
+    for (int i = 0; i < ports; i++)
+    {
+        write(master[i], bus[i], strlen(bus[i]));
+    }
+    int frames = 0;
+    for (int k = 0; k < 20 && frames < 5; k++)
+    {
+        frames += gw.poll(100);
+    }
+    // a response larger than the queue is refused without writing any of it
+    std::string big(USC_GATEWAY_OUTSIZE + 1, 'x');
+    bool queued = gw.respond(0, big.c_str());
+    printf("Oversized: %d, next: %d\n", queued, gw.respond(0, "0:ok") && gw.flush(0));
+    for (int i = 0; i < ports; i++)
+    {
+        char buf[256];
+        ssize_t n = read(master[i], buf, sizeof(buf) - 1);
+        buf[n > 0 ? n : 0] = 0;
+        printf("Port %d: %s\n", i, buf);
+        ::close(master[i]);
+    }
+    printf("Frames: %d\n", frames);
+}
+
+void onReply(usc::PendingTable &, uint16_t id, void *ctx, const usc::FrameView *resp) {
+    if (resp != nullptr)
+    {
+        printf("  #%u (request %d): %.*s\n", id, (int)(intptr_t)ctx, (int)resp->frame().len, resp->frame().ptr);
+    }
+    else
+    {
+        printf("  #%u (request %d): timeout\n", id, (int)(intptr_t)ctx);
+    }
+}
+
+void testPending() {
+    // five requests in one write, the device answers in reverse order and drops one
+    usc::PendingTable tbl(4, onReply);
+    uint64_t now = 1000;
+    char req[256];
+    usc::CommandEncoder enc(req, sizeof(req));
+    for (int i = 0; i < 5; i++)
+    {
+        int id = tbl.add(100, (void *)(intptr_t)i, now);
+        printf("Request %d: id %d\n", i, id);
+        if (id >= 0)
+        {
+            enc.begin().device(1).component(10 + i).id(id).action("get").end();
+        }
+    }
+
+    usc::Command dev(1);
+    uint16_t ids[8], comps[8];
+    int n = 0;
+    const char *p = enc.data();
+    size_t len = enc.length();
+    while (len > 0)
+    {
+        usc::Result res;
+        size_t used = dev.process(p, len, res);
+        p += used;
+        len -= used;
+        if (res == usc::OK && dev.hasId())
+        {
+            ids[n] = dev.id();
+            comps[n++] = dev.component();
+        }
+    }
+    char out[256];
+    usc::ResponseWriter resp(out, sizeof(out));
+    for (int i = n - 1; i >= 0; i--)
+    {
+        if (i != 1)
+        {
+            resp.begin().device(1).component(comps[i]).id(ids[i]).param("v", (long)comps[i] * 2).end();
+        }
+    }
+    // late duplicate
+    resp.begin().device(1).component(comps[0]).id(ids[0]).end();
+    printf("Responses: %s\n", resp.data());
+
+    usc::FrameView view;
+    p = resp.data();
+    len = resp.length();
+    int matched = 0, unknown = 0;
+    while (len > 0)
+    {
+        size_t used;
+        usc::Result res = view.parse(p, len, used);
+        if (res == usc::Next)
+        {
+            break;
+        }
+        p += used;
+        len -= used;
+        if (res == usc::OK)
+        {
+            tbl.complete(view) ? matched++ : unknown++;
+        }
+    }
+    printf("Matched: %d, unknown: %d, pending: %u, next timeout: %d\n", matched, unknown, tbl.size(),
+           tbl.nextTimeout(now + 40));
+    printf("Expired at +50: %d\n", tbl.expire(now + 50));
+    int expired = tbl.expire(now + 100);
+    printf("Expired at +100: %d, pending: %u, next timeout: %d\n", expired, tbl.size(), tbl.nextTimeout(now + 100));
+}
+
+void testCapture() {
+    // a chunk split inside a frame, a chunk larger than one varint byte and a long pause
+    const char *path = "capture.bin";
+    usc::CaptureWriter cap;
+    cap.open(path);
+    std::string big(300, 'x');
+    cap.write(0, "!1:2/se", 7, 5000);
+    cap.write(0, "t?a=1$", 6, 5250);
+    cap.write(1, big.data(), big.size(), 5300);
+    cap.write(1, "!2/ping$", 8, 5300 + 3600000000ULL);
+    printf("Written: %llu records, %llu bytes\n", (unsigned long long)cap.records(),
+           (unsigned long long)cap.bytes());
+    cap.close();
+
+    usc::CaptureReader rd;
+    rd.open(path);
+    usc::CaptureRecord rec;
+    usc::Command cmd[2];
+    while (rd.next(rec))
+    {
+        printf("  +%llu us port %u: %zu bytes", (unsigned long long)rec.time, rec.port, rec.length);
+        const char *p = rec.data;
+        size_t n = rec.length;
+        while (n > 0)
+        {
+            usc::Result res;
+            size_t used = cmd[rec.port].process(p, n, res);
+            p += used;
+            n -= used;
+            if (res == usc::OK)
+            {
+                printf(", frame %s", cmd[rec.port].action());
+            }
+        }
+        printf("\n");
+    }
+    printf("Truncated: %d\n", rd.isTruncated());
+    size_t size = rd.size();
+    rd.close();
+
+    // the recorder died inside the last record
+    truncate(path, size - 3);
+    rd.open(path);
+    int records = 0;
+    while (rd.next(rec))
+    {
+        records++;
+    }
+    printf("Cut short: %d records, truncated: %d\n", records, rd.isTruncated());
+    rd.close();
+
+    // the gateway records what it reads, a file port is read to its end
+    std::ofstream("capture.txt") << "!1/a$!1/b$";
+    usc::Gateway gw(1, usc::Gateway::Epoll);
+    gw.attachCapture(&cap);
+    cap.open(path);
+    gw.open("capture.txt", 1);
+    int frames = 0;
+    while (gw.isOpen(0))
+    {
+        frames += gw.poll(0);
+    }
+    cap.close();
+    rd.open(path);
+    rd.next(rec);
+    printf("Gateway: %d frames, recorded %.*s\n", frames, (int)rec.length, rec.data);
+    rd.close();
+    unlink("capture.txt");
+    unlink(path);
+}
+
+int main()
+{
+    testRing();
+    printf("\n==========\n");
+    testEngine();
+    printf("\n==========\n");
+    testGateway(usc::Gateway::Epoll);
+    testGateway(usc::Gateway::IoUring);
+    printf("\n==========\n");
+    testPending();
+    printf("\n==========\n");
+    testCapture();
+    return 0;
+}
@@ -1,6 +1,18 @@
+#include <cmath>
+#include <climits>
+#include <cstddef>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <string>
 #include "../src/USCommand.h"
+#include "../src/USCView.h"
+#include "../src/USCDispatch.h"
+#include "../src/USCPool.h"
+#include "../src/USCWriter.h"
+#include "../src/USCFrame.h"
 
 uint8_t xorall(const char *data)
 {
@@ -106,6 +118,16 @@ void testParse() {
                     }
                     par.begin();
                 }
+                for (int i = 0; i < cmd.params().count(); i++)
+                {
+                    usc::KeyVal kv = cmd.params()[i];
+                    printf("  Pars[#%d] `%s` (%d) > `%s` (%d)\n", i, kv.key(), kv.keyLength(),
+                           kv.safeValue(), kv.valueLength());
+                }
+                if (cmd.params().find("e").hasValue())
+                {
+                    printf("  Find `e` > `%s`\n", cmd.params().find("e").value());
+                }
 
                 printf("\n");
                 str.clear();
@@ -123,10 +145,906 @@ void testParse() {
     }
 }
 
+void testBulk() {
+    usc::Command cmd;
+
+    std::ifstream file("input.txt");
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // feed in small chunks so frames straddle chunk boundaries
+    const size_t chunk = 7;
+    const char *p = input.data();
+    size_t n = input.size();
+    while (n > 0)
+    {
+        usc::Result res;
+        size_t used = cmd.process(p, n < chunk ? n : chunk, res);
+        p += used;
+        n -= used;
+
+        switch (res)
+        {
+        case usc::OK:
+            printf("'%s' | Device: %d, component: %d -> %d, Par: %d, CHK=%X\n",
+                   cmd.data(), cmd.device(), cmd.component(), cmd.isResponse(),
+                   cmd.params().count(), cmd.checksum());
+            break;
+        case usc::Next:
+            break;
+        default:
+            printf("'%s' | Err: %d, used: %d, discarded: %d\n", cmd.data(), (int)res, (int)used,
+                   (int)cmd.discarded());
+            break;
+        }
+    }
+}
+
+void testView() {
+    std::ifstream file("input.txt");
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    usc::FrameView view;
+    const char *p = input.data();
+    size_t n = input.size();
+    while (n > 0)
+    {
+        size_t used;
+        usc::Result res = view.parse(p, n, used);
+        if (res == usc::Next)
+        {
+            break;
+        }
+        if (res == usc::OK)
+        {
+            printf("`%.*s` | Device: %d, component: %d -> %d, Par: %d, CHK=%X\n",
+                   (int)view.frame().len, view.frame().ptr, view.device(), view.component(),
+                   view.isResponse(), view.count(), view.checksum());
+            if (view.hasAction())
+            {
+                printf("  Action: `%.*s`\n", (int)view.action().len, view.action().ptr);
+            }
+            for (int i = 0; i < view.count(); i++)
+            {
+                char val[32];
+                view.copyValue(i, val, sizeof(val));
+                printf("  Pars (%d): `%.*s` > `%s`\n", view.isEscaped(i),
+                       (int)view.key(i).len, view.key(i).ptr, val);
+            }
+        }
+        else
+        {
+            printf("Err: %d, used: %d\n", (int)res, (int)used);
+        }
+        p += used;
+        n -= used;
+    }
+}
+
+void onRoute(usc::Command &c, usc::Params &par) {
+    printf("[ROUTE] com: %d, action: %s, hash: %08X, pars: %d\n", c.component(), c.action(),
+           (unsigned)c.actionHash(), par.count());
+}
+
+void testDispatch() {
+    static const usc::Route routes[] = {
+        {100, "test/abcde", onRoute, nullptr},
+        {11, "test", onRoute, nullptr},
+        {0, "", onRoute, nullptr},
+    };
+    usc::DispatchTable<3> dispatcher(routes);
+    printf("Build: %d\n", dispatcher.build());
+
+    usc::Command cmd(18);
+    cmd.attachDispatcher(&dispatcher);
+    cmd.attachCallback(onCommand);
+
+    std::ifstream file("input.txt");
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const char *p = input.data();
+    size_t n = input.size();
+    while (n > 0)
+    {
+        usc::Result res;
+        size_t used = cmd.process(p, n, res);
+        p += used;
+        n -= used;
+    }
+}
+
+struct Move {
+    int speed;
+    long steps;
+    float ratio;
+    const char *name;
+    bool fast;
+};
+
+static const usc::Field moveFields[] = {
+    {"s", usc::FieldInt, offsetof(Move, speed), true, 0, 100, 0},
+    {"n", usc::FieldLong, offsetof(Move, steps), false, -100000, 100000, 1},
+    {"r", usc::FieldFloat, offsetof(Move, ratio), false, 0.5, 2, 1},
+    {"name", usc::FieldString, offsetof(Move, name), false, 1, 8, 0},
+    {"fast", usc::FieldFlag, offsetof(Move, fast), false, 0, 0, 0},
+};
+static const usc::Schema moveSchema = {moveFields, 5, sizeof(Move)};
+
+void onMove(usc::Command &, usc::Params &par) {
+    const Move &m = par.args<Move>();
+    printf("[MOVE] speed %d, steps %ld, ratio %.2f, name '%s', fast %d\n", m.speed, m.steps, m.ratio, m.name, m.fast);
+}
+
+void onRejected(usc::Result res, usc::Command &c) {
+    printf("[REJECTED] %d, action: %s, pars: %d\n", (int)res, c.action(), c.params().count());
+}
+
+void testSchema() {
+    static const usc::Route routes[] = {
+        {1, "move", onMove, &moveSchema},
+        {1, "raw", onRoute, nullptr},
+    };
+    usc::DispatchTable<2> dispatcher(routes);
+    printf("Build: %d\n", dispatcher.build());
+
+    usc::Command cmd(1);
+    cmd.attachDispatcher(&dispatcher);
+    cmd.attachCallback(onCommand, onRejected);
+    const char *frames[] = {"!1:1/move?s=50$", "!1:1/move?s=100&n=-2000&r=1.25&name=left&fast$",
+                            "!1:1/move?fast=0&s=0$", "!1:1/move?n=5$", "!1:1/move?s=101$", "!1:1/move?s=5x$",
+                            "!1:1/move?s=5&s=6$", "!1:1/move?s=5&x=1$", "!1:1/move?s=5&r=3$",
+                            "!1:1/move?s=5&name=toolongname$", "!1:1/move?s=5&fast=2$", "!1:1/move?s$",
+                            "!1:1/raw?anything=1$", "!1:1/move?s=+5$", "!1:1/move?s= 5$", "!1:1/move?s=-$",
+                            "!1:1/move?s=5&r=1e0$", "!1:1/move?s=5&r=1.2.5$", "!1:1/move?s=5&r=.75$"};
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        usc::Result res;
+        printf("%s -> ", frames[i]);
+        cmd.process(frames[i], strlen(frames[i]), res);
+        printf("   result: %d\n", (int)res);
+    }
+
+    // a rejected frame is not OK for process(char) either
+    const char *bad = "!1:1/move?s=101$";
+    usc::Result res = usc::Next;
+    while (*bad) {
+        res = cmd.process(*bad++);
+    }
+    printf("   per char: %d\n", (int)res);
+#if USC_STATS
+    printf("Frames: %lu, invalid: %lu\n", (unsigned long)cmd.stats().frames,
+           (unsigned long)cmd.stats().errors[usc::Invalid]);
+#endif
+}
+
+void onStream(uint8_t stream, usc::Command &c) {
+    printf("[%d] '%s' | Device: %d, component: %d -> %d, Par: %d\n", stream, c.data(), c.device(),
+           c.component(), c.isResponse(), c.params().count());
+}
+
+void onStreamError(uint8_t stream, usc::Result res, usc::Command &c) {
+    printf("[%d] Err: %d, discarded: %d\n", stream, (int)res, (int)c.discarded());
+}
+
+void testPool() {
+    usc::PoolTable<3> pool;
+    pool.attachCallback(onStream, onStreamError);
+
+    std::ifstream file("input.txt");
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // the same input on every stream, chunks of the streams interleaved
+    const size_t chunk = 5;
+    for (size_t i = 0; i < input.size(); i += chunk)
+    {
+        size_t n = input.size() - i < chunk ? input.size() - i : chunk;
+        for (uint8_t s = 0; s < pool.size(); s++)
+        {
+            pool.process(s, input.data() + i, n);
+        }
+    }
+}
+
+void testWriter() {
+    char buf[96];
+    usc::ResponseWriter resp(buf, sizeof(buf));
+
+    resp.begin().device(0).device(0).device(1).device(2).component(100).action("test/abcde")
+        .param("t", 1L).param("s", "a&b|c=\\$\r\n").param("k").end();
+    resp.begin().device(10).text("done").end(false);
+    printf("Responses: %s (%d)\n", resp.data(), (int)resp.length());
+    printf("Checksum: %d\n", resp.checksum());
+
+    usc::Command cmd;
+    usc::Result res;
+    const char *p = resp.data();
+    size_t n = resp.length();
+    while (n > 0)
+    {
+        size_t used = cmd.process(p, n, res);
+        p += used;
+        n -= used;
+        printf("Parse: %d, response: %d\n", (int)res, cmd.isResponse());
+    }
+
+    // escaped values read back by the parser
+    resp.clear();
+    resp.begin().device(7).action("set").param("s", "a&b|c=\\$\r\n").end(false);
+    buf[0] = '!';
+    p = resp.data();
+    n = resp.length();
+    while (n > 0)
+    {
+        size_t used = cmd.process(p, n, res);
+        p += used;
+        n -= used;
+    }
+    printf("Parse: %d, value ok: %d\n", (int)res,
+           strcmp(cmd.params()[0].value(), "a&b|c=\\$\r\n") == 0);
+
+    // a frame that does not fit is dropped, the complete ones are kept
+    size_t len = resp.begin().device(1).text("0123456789012345678901234567890123456789"
+                                                         "0123456789012345678901234567890123456789").end();
+    printf("Overflow: %d, len: %d, total: %d\n", resp.overflow(), (int)len, (int)resp.length());
+
+    // numbers without digits drop their frame, the next frame is written again
+    const double bad[] = {NAN, INFINITY, -INFINITY, 1e30};
+    for (int i = 0; i < 4; i++) {
+        len = resp.begin().device(1).param("v", bad[i], 1).end();
+        printf("Value %d: overflow %d, len %d, ", i, resp.overflow(), (int)len);
+    }
+    len = resp.begin().device(1).param("v", -2.5, 1).end();
+    printf("next: overflow %d, len %d, total %d\n", resp.overflow(), (int)len, (int)resp.length());
+
+    // the widest numbers, compared with printf
+    char exp[64];
+    resp.clear();
+    resp.begin().device(1).param("u", 12345678901UL).param("l", LONG_MIN).end(false);
+    snprintf(exp, sizeof(exp), "@1?u=%lu&l=%ld$", 12345678901UL, LONG_MIN);
+    printf("Number: %s, ok: %d\n", resp.data(), strcmp(resp.data(), exp) == 0);
+    resp.clear();
+    resp.begin().device(1).param("u", ULONG_MAX).param("d", 1e12, 0).end(false);
+    snprintf(exp, sizeof(exp), "@1?u=%lu&d=1000000000000$", ULONG_MAX);
+    printf("Number: %s, ok: %d\n", resp.data(), strcmp(resp.data(), exp) == 0);
+}
+
+void testEncoder() {
+    char buf[512];
+    usc::CommandEncoder enc(buf, sizeof(buf));
+
+    // a sweep over the components of device 0.0.1.2, many frames in one buffer
+    const uint8_t addr[] = {0, 0, 1, 2};
+    for (uint16_t comp = 1; comp <= 100; comp++)
+    {
+        enc.begin().address(addr, 4).component(comp).action("set").action("level")
+            .param("v", -(long)comp).param("f", comp / 8.0, 3).param("n", "x=1&y").end();
+        if (enc.overflow())
+        {
+            break;
+        }
+    }
+    printf("Frames: %d, length: %d\n", (int)enc.frames(), (int)enc.length());
+    printf("First: %.*s\n", (int)(strchr(buf, '$') + 1 - buf), buf);
+
+    usc::Command cmd(18);
+    int ok = 0, bad = 0;
+    const char *p = enc.data();
+    size_t n = enc.length();
+    while (n > 0)
+    {
+        usc::Result res;
+        size_t used = cmd.process(p, n, res);
+        p += used;
+        n -= used;
+        if (res == usc::OK && cmd.hasChecksum() && cmd.device() == 18 &&
+            cmd.params().find("v").valueInt() == -cmd.component() &&
+            strcmp(cmd.params().find("n").value(), "x=1&y") == 0)
+        {
+            ok++;
+        }
+        else if (res != usc::Next)
+        {
+            bad++;
+        }
+    }
+    printf("Parsed: %d, failed: %d\n", ok, bad);
+}
+
+void printFrames(const usc::Frame **frames, int n, const usc::Arena &arena) {
+    printf("Batch: %d frames, %d bytes\n", n, (int)arena.used());
+    for (int i = 0; i < n; i++) {
+        const usc::Frame *f = frames[i];
+        printf("  %s | dev: %u, comp: %d, action: %s, pars: %d", f->data(), f->device(), f->component(),
+               f->action(), f->count());
+        usc::KeyVal t = f->find("t");
+        if (t.hasValue()) {
+            printf(", t: %ld", t.valueLong());
+        }
+        printf("\n");
+    }
+}
+
+void testChecksum() {
+    // the same frame through every parser, then with one byte changed
+    char buf[128];
+    usc::CommandEncoder enc(buf, sizeof(buf));
+    enc.begin().device(0).device(0).device(1).device(2).component(7).action("set")
+        .param("v", 42L).param("s", "a&b").end();
+    printf("Mode: %d, frame: %s, checksum: %X\n", USC_CHECKSUM, buf, enc.checksum());
+
+    for (int k = 0; k < 2; k++)
+    {
+        if (k == 1)
+        {
+            // v=42 becomes v=52
+            strstr(buf, "42")[0] ^= 0x01;
+        }
+        usc::Command one(18), bulk(18);
+        usc::Result res1 = usc::Next, res2;
+        for (const char *p = buf; *p != 0 && res1 == usc::Next; p++)
+        {
+            res1 = one.process(*p);
+        }
+        bulk.process(buf, strlen(buf), res2);
+        if (res2 == usc::Next)
+        {
+            // an invalid frame is reported when the next one starts
+            bulk.process("!", 1, res2);
+        }
+        usc::FrameView view;
+        size_t used;
+        usc::Result res3 = view.parse(buf, strlen(buf), used);
+        printf("Char: %d (%X), bulk: %d (%X), view: %d (%X)\n", (int)res1, one.checksum(),
+               (int)res2, bulk.checksum(), (int)res3, view.checksum());
+    }
+
+#if USC_CHECKSUM != USC_CHECKSUM_XOR
+    // a CRC without its leading zero is rejected, even though the value matches
+    for (long v = 0;; v++)
+    {
+        int n = snprintf(buf, sizeof(buf), "!1/a?v=%ld|", v);
+        usc::check::Value chk = usc::check::update(usc::check::Init, buf, n);
+        if (chk >> (4 * (usc::check::Digits - 1)) == 0)
+        {
+            snprintf(buf + n, sizeof(buf) - n, "%X$", chk);
+            break;
+        }
+    }
+    usc::Command one(1), bulk(1);
+    usc::Result res1 = usc::Next, res2;
+    for (const char *p = buf; *p != 0 && res1 == usc::Next; p++)
+    {
+        res1 = one.process(*p);
+    }
+    bulk.process(buf, strlen(buf), res2);
+    if (res2 == usc::Next)
+    {
+        bulk.process("!", 1, res2);
+    }
+    usc::FrameView view;
+    size_t used;
+    printf("Short: %s, char: %d, bulk: %d, view: %d\n", buf, (int)res1, (int)res2,
+           (int)view.parse(buf, strlen(buf), used));
+#endif
+}
+
+void onFiltered(bool bcast, uint16_t comp, const char *action, usc::Params &par) {
+    printf("  [%s] bcast: %d, com: %d, pars: %d\n", action, bcast, comp, par.count());
+}
+
+void testFilter() {
+    // node 0.0.2.5 on a shared bus, also listening to 0.0.3.*
+    const char *bus = "!0.0.2.5:1/own$!0.0.2.6:1/other$!0.0.3.9/group?v=a\\$b&w=2$"
+                      "!7/other?v=a\\$b|0$!0/all$!2.5/short$!3.200/group2$!1.0.3.1/other$"
+                      "!0.0.9.1:5|0$!0.0.2.5:2/own2|bad$";
+
+    for (int k = 0; k < 2; k++) {
+        usc::Command cmd(0x25), bulk(0x25);
+        cmd.attachCallback(onFiltered);
+        bulk.attachCallback(onFiltered);
+        printf("Mask: %d, skip: %d\n", cmd.setAddressFilter("0.0.3.*", k == 1), k == 1);
+        bulk.setAddressFilter("0.0.3.*", k == 1);
+        int ok = 0, err = 0;
+        for (const char *p = bus; *p != 0; p++) {
+            usc::Result res = cmd.process(*p);
+            ok += res == usc::OK;
+            err += res != usc::OK && res != usc::Next;
+        }
+        printf("Per char: ok %d, errors %d\n", ok, err);
+
+        usc::Result res;
+        ok = 0;
+        err = 0;
+        const char *p = bus;
+        size_t n = strlen(bus);
+        while (n > 0) {
+            size_t used = bulk.process(p, n, res);
+            p += used;
+            n -= used;
+            ok += res == usc::OK;
+            err += res != usc::OK && res != usc::Next;
+        }
+        printf("Bulk: ok %d, errors %d, pending %d\n", ok, err, (int)bulk.discarded());
+    }
+
+    // a start marker outside a value ends a skipped frame, `!` in a value does not
+    const char *cut = "!6:1/oth!5:1/own$!6/oth?a=!5/in$!5:1/two$!6/x?k!5/key$!6|!5/chk$";
+    for (int k = 0; k < 2; k++) {
+        usc::Command node(5);
+        node.setAddressFilter(nullptr, k == 1);
+        printf("Cut, skip %d:", k);
+        for (const char *p = cut; *p != 0; p++) {
+            usc::Result res = node.process(*p);
+            if (res != usc::Next) {
+                printf(" %d (%s)", (int)res, node.action());
+            }
+        }
+        usc::Result res;
+        node.clear();
+        printf(", bulk:");
+        const char *p = cut;
+        size_t n = strlen(cut);
+        while (n > 0) {
+            size_t used = node.process(p, n, res);
+            p += used;
+            n -= used;
+            if (res != usc::Next) {
+                printf(" %d (%s)", (int)res, node.action());
+            }
+        }
+        printf("\n");
+    }
+
+    usc::Command cmd;
+    printf("Invalid masks: %d %d %d\n", cmd.setAddressFilter("0.0.256.*"), cmd.setAddressFilter("1..2"),
+           cmd.setAddressFilter("1.2.3.4.5"));
+}
+
+void testId() {
+    const char *frames[] = {"!1:3#42/format$", "!0.0.2.5#7$", "!1#/x?a=1$", "!1#65536/x$", "!1:2#3#4/x$",
+                            "!1/x#5$", "!1:2#99|0$"};
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        const char *f = frames[i];
+        usc::Command one, bulk;
+        usc::Result r1 = usc::Next, r2;
+        for (const char *p = f; *p != 0 && r1 == usc::Next; p++) {
+            r1 = one.process(*p);
+        }
+        bulk.process(f, strlen(f), r2);
+        if (r2 == usc::Next) {
+            bulk.process("!", 1, r2);
+        }
+        usc::FrameView view;
+        size_t used;
+        usc::Result r3 = view.parse(f, strlen(f), used);
+        printf("%-16s char: %d (%d #%u), bulk: %d (%d #%u), view: %d (%d #%u)\n", f, (int)r1, one.hasId(), one.id(),
+               (int)r2, bulk.hasId(), bulk.id(), (int)r3, view.hasId(), view.id());
+    }
+
+    // the response echoes the id of its request
+    char buf[64];
+    usc::CommandEncoder enc(buf, sizeof(buf));
+    enc.begin().device(1).component(3).id(1234).action("read").end();
+    usc::Command cmd(1);
+    usc::Result res;
+    cmd.process(enc.data(), enc.length(), res);
+    char out[64];
+    usc::ResponseWriter resp(out, sizeof(out));
+    resp.begin().device(1).component(cmd.component()).id(cmd.id()).param("v", 7L).end();
+    usc::FrameView view;
+    size_t used;
+    res = view.parse(resp.data(), resp.length(), used);
+    printf("Request: %s, response: %s -> %d, id: %d #%u\n", enc.data(), resp.data(), (int)res, view.hasId(), view.id());
+}
+
+void printParsed(const char *name, usc::Result res, usc::Command &cmd) {
+    printf("%s: res %d, data %s, dev %u, comp %u, id %d #%u, action %s, chk %d", name, (int)res, cmd.data(), cmd.device(),
+           cmd.component(), cmd.hasId(), cmd.id(), cmd.action(), cmd.hasChecksum());
+    usc::Params &pars = cmd.params();
+    for (pars.begin(); pars.next();) {
+        printf(", %s=%s", pars.kv().key(), pars.kv().hasValue() ? pars.kv().value() : "(none)");
+    }
+    printf("\n");
+}
+
+#if USC_BINARY
+void testBinary() {
+    char text[128], bin[128];
+    usc::CommandEncoder te(text, sizeof(text)), be(bin, sizeof(bin));
+    const uint8_t addr[] = {0, 0, 1, 2};
+    te.begin().address(addr, 4).component(300).id(42).action("set").action("level").param("v", 10).param("on").end();
+    be.beginBinary().address(addr, 4).component(300).id(42).action("set").action("level").param("v", 10).param("on").end();
+    printf("Text %d bytes: %s\nBinary %d bytes:", (int)te.length(), te.data(), (int)be.length());
+    for (size_t i = 0; i < be.length(); i++) {
+        printf(" %02X", (uint8_t)bin[i]);
+    }
+    printf("\n");
+
+    // same fields through char, bulk and a pool stream fed one byte per call
+    usc::Command one, bulk;
+    usc::Result r1 = usc::Next, r2;
+    for (size_t i = 0; i < be.length() && r1 == usc::Next; i++) {
+        r1 = one.process(bin[i]);
+    }
+    printParsed("Char", r1, one);
+    bulk.process(bin, be.length(), r2);
+    printParsed("Bulk", r2, bulk);
+    usc::PoolTable<2> pool;
+    for (size_t i = 0; i < be.length(); i++) {
+        pool.process(1, bin + i, 1, r2);
+    }
+    printParsed("Pool", r2, pool.command());
+
+    // text and binary frames mixed, a value with raw bytes, frames without action or params
+    char buf[256];
+    usc::CommandEncoder enc(buf, sizeof(buf));
+    enc.beginBinary().device(7).end();
+    enc.begin().device(7).action("text").end();
+    enc.beginBinary().device(7).param("raw", "a&b$\\c").end();
+    enc.beginBinary().device(7).component(1).action("on").end();
+    enc.beginBinary().device(7).action("empty").param("e", "").end();
+    printf("Mixed: %d frames, %d bytes\n", (int)enc.frames(), (int)enc.length());
+    usc::Command cmd(7);
+    const char *p = buf;
+    size_t n = enc.length();
+    while (n > 0) {
+        size_t used = cmd.process(p, n, r2);
+        p += used;
+        n -= used;
+        if (r2 == usc::OK) {
+            printParsed("  Frame", r2, cmd);
+        }
+    }
+
+    // a broken CRC, a bad flags byte and a foreign frame passed over by length
+    const char *names[] = {"Bad crc", "Bad flags", "Skipped"};
+    for (int k = 0; k < 3; k++) {
+        enc.clear();
+        enc.beginBinary().device(k == 2 ? 8 : 7).action("x").param("k", "!@$").end();
+        if (k == 0) {
+            buf[enc.length() - 1] ^= 1;
+        } else if (k == 1) {
+            buf[2] = 0x47;
+        }
+        enc.begin().device(7).action("next").end();
+        usc::Command node(7);
+        node.setAddressFilter();
+        p = buf;
+        n = enc.length();
+        printf("%s:", names[k]);
+        while (n > 0) {
+            size_t used = node.process(p, n, r2);
+            p += used;
+            n -= used;
+            if (r2 != usc::Next) {
+                printf(" %d (%s)", (int)r2, node.action());
+            }
+        }
+        printf("\n");
+    }
+}
+#endif
+
+enum Word { wMotor, wLeft, wRight, wSpeed, wStop };
+static const char *const words[] = {"motor", "left", "right", "speed", "stop"};
+
+void onSegments(uint8_t stream, usc::Command &c) {
+    printf("[%d] %-22s segments %d:", stream, c.action(), c.actionSegments());
+    for (uint8_t i = 0; i < c.actionSegments(); i++) {
+        printf(" %.*s(%d)", c.segmentLength(i), c.segment(i), c.segmentId(i));
+    }
+    // routing on ids, no string compares
+    if (c.segmentId(0) == wMotor && c.actionSegments() == 3 && c.segmentId(2) == wSpeed) {
+        printf(" -> %s speed %d", c.segmentId(1) == wLeft ? "left" : "right", c.params().find("v").valueInt());
+    }
+    printf("\n");
+}
+
+void testSegments() {
+    usc::VocabularyTable<5> vocab(words);
+    printf("Vocabulary: %d words, 'stop' = %d, 'go' = %d\n", vocab.size(), vocab.find("stop"), vocab.find("go"));
+
+    const char *input = "!1/motor/left/speed?v=10$!1/motor/right/speed?v=20$!1/motor/stop$!1/x//y$!1$"
+                        "!1/a/b/c/d/e$!1/test/abcde$@1/motor/left$!1/stop/$";
+    usc::PoolTable<2> pool;
+    pool.command().attachVocabulary(&vocab);
+    pool.attachCallback(onSegments);
+    pool.process(0, input, strlen(input));
+
+    // the same frames byte by byte into a command without vocabulary
+    usc::Command cmd(1);
+    for (const char *p = input; *p != 0; p++) {
+        if (cmd.process(*p) == usc::OK && cmd.hasAction()) {
+            printf("%s: %d %d, ", cmd.action(), cmd.actionSegments(), cmd.segmentIs(cmd.actionSegments() - 1, "speed"));
+        }
+    }
+    printf("\n");
+}
+
+void testFrame() {
+    std::ifstream file("input.txt");
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // frames are printed after the parser moved on, a full arena ends the batch
+    usc::ArenaBuffer<256> arena;
+    const usc::Frame *frames[16];
+    int n = 0;
+    usc::Command cmd;
+    usc::Result res;
+    const char *p = input.data();
+    size_t len = input.size();
+    while (len > 0) {
+        size_t used = cmd.process(p, len, res);
+        p += used;
+        len -= used;
+        if (res != usc::OK) {
+            continue;
+        }
+        const usc::Frame *f = usc::Frame::create(arena, cmd);
+        if (f == nullptr || n == 16) {
+            printFrames(frames, n, arena);
+            arena.reset();
+            n = 0;
+            f = usc::Frame::create(arena, cmd);
+        }
+        frames[n++] = f;
+    }
+    printFrames(frames, n, arena);
+}
+
+// small node: no checksum, escapes or responses, single number addresses and none of the
+// parts around the parser
+typedef usc::CommandConfig<32, 2, false, false, false, 1, false, 0> LeanConfig;
+typedef usc::CommandConfig<512, 32> WideConfig;
+
+// what the lean config costs on top of its buffer and counters, at most this much on a 64 bit host
+static const int LeanOverhead = 100;
+#if USC_STATS
+static const int LeanStats = sizeof(usc::BasicStats<LeanConfig::bufSize>);
+#else
+static const int LeanStats = 0;
+#endif
+static_assert(sizeof(usc::BasicCommand<LeanConfig>) <= LeanConfig::bufSize + LeanStats + LeanOverhead,
+              "lean command grew");
+
+template <typename Cfg>
+void parseWith(usc::BasicCommand<Cfg> &cmd, const char *name, const std::string &frame) {
+    usc::Result res = usc::Next;
+    for (size_t i = 0; i < frame.size() && res == usc::Next; i++) {
+        res = cmd.process(frame[i]);
+    }
+    printf("%s: %s | res: %d, dev: %u, comp: %d, action: %s, pars: %d\n", name, frame.c_str(), (int)res,
+           cmd.device(), cmd.component(), cmd.action(), cmd.params().count());
+}
+
+void testConfig() {
+    usc::BasicCommand<LeanConfig> lean(5);
+    usc::BasicCommand<WideConfig> wide;
+    printf("Size: lean %d, default %d, wide %d\n", (int)sizeof(lean), (int)sizeof(usc::Command), (int)sizeof(wide));
+    printf("Lean overhead: %d (max %d)\n", (int)(sizeof(lean) - LeanConfig::bufSize - LeanStats), LeanOverhead);
+
+    const char *frames[] = {"!5:2/set?a=1&b=2$", "!5:2/set?a=1&b=2&c=3$", "!0.5/on$", "!5/on|42$", "@5/ok$",
+                            "!5/set?p=c:\\tmp$"};
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        lean.clear();
+        wide.clear();
+        parseWith(lean, "Lean", frames[i]);
+        parseWith(wide, "Wide", frames[i]);
+    }
+
+    // more params and bytes than the default buffer holds
+    std::string big = "!1:1/fill";
+    for (int i = 0; i < 20; i++) {
+        big += i == 0 ? "?" : "&";
+        big += "k" + std::to_string(i) + "=0123456789";
+    }
+    big += "$";
+    wide.clear();
+    parseWith(wide, "Wide", big);
+    printf("Wide: k19 = %s\n", wide.params().find("k19").safeValue());
+}
+
+template <typename Cfg>
+void countResults(const char *name, usc::BasicCommand<Cfg> &cmd, const char *input, size_t len) {
+    int ok = 0, err = 0;
+    for (size_t i = 0; i < len; i++) {
+        usc::Result res = cmd.process(input[i]);
+        ok += res == usc::OK;
+        err += res != usc::OK && res != usc::Next;
+    }
+    printf("  %s per char: ok %d, errors %d", name, ok, err);
+
+    cmd.clear();
+    ok = 0;
+    err = 0;
+    int calls = 0;
+    while (len > 0 && calls++ < 100) {
+        usc::Result res;
+        size_t used = cmd.process(input, len, res);
+        input += used;
+        len -= used;
+        ok += res == usc::OK;
+        err += res != usc::OK && res != usc::Next;
+    }
+    printf(", bulk: ok %d, errors %d, left %d\n", ok, err, (int)len);
+}
+
+void testResync() {
+    // an escaped backslash ends a response like any other escaped byte
+    const char *resp = "@1/a\\\\$!1/b$@1/c\\$\\\\$!1/d$";
+    usc::Command cmd;
+    printf("Responses: %s\n", resp);
+    countResults("Default", cmd, resp, strlen(resp));
+
+    // without responses `@` is garbage, it is passed over and not parsed again
+    const char *noResp = "!5/a$@5/b$!5/c$@@!5/d$";
+    usc::BasicCommand<LeanConfig> lean(5);
+    printf("No responses: %s\n", noResp);
+    countResults("Lean", lean, noResp, strlen(noResp));
+
+    // a stray STX in front of a text frame: as len, as len with a bad flags byte
+    const char *stx = "\x02!7/a$\x02\x05!7/b$\x02\x05x!7/c$";
+    usc::Command text(7);
+    printf("Stray STX:\n");
+    countResults("Default", text, stx, strlen(stx));
+
+#if USC_BINARY
+    // a wrong checksum byte which looks like a start marker does not start a frame
+    char buf[64];
+    usc::CommandEncoder enc(buf, sizeof(buf));
+    for (int k = 0; k < 2; k++) {
+        enc.clear();
+        enc.beginBinary().device(7).action("x").end();
+        char &crc = buf[enc.length() - 1];
+        crc = crc == (k == 0 ? '!' : 0x02) ? '@' : (k == 0 ? '!' : 0x02);
+        enc.begin().device(7).action("next").end();
+        usc::Command node(7);
+        printf("Checksum byte %02X:\n", (uint8_t)crc);
+        countResults("Default", node, buf, enc.length());
+    }
+#endif
+
+    // garbage after a frame which filled the buffer is unexpected, not an overflow
+    std::string full = "!5/" + std::string(28, 'a') + "$x";
+    usc::BasicCommand<LeanConfig> small(5);
+    printf("Full buffer:");
+    for (size_t i = 0; i < full.size(); i++) {
+        usc::Result res = small.process(full[i]);
+        if (res != usc::Next) {
+            printf(" %d", (int)res);
+        }
+    }
+    printf(", action: %s\n", small.action());
+}
+
+template <typename Cfg>
+void parseNumber(usc::BasicCommand<Cfg> &cmd, const char *name, const char *value) {
+    std::string frame = std::string("!1/n?v=") + value + "$";
+    cmd.clear();
+    for (size_t i = 0; i < frame.size(); i++) {
+        cmd.process(frame[i]);
+    }
+    // the second read comes from the cache, strtol() is the reference
+    usc::KeyVal kv = cmd.params().find("v");
+    long first = kv.valueLong();
+    printf("  %s %s: %ld, %ld (%ld)\n", name, value, first, kv.valueLong(), strtol(value, NULL, 10));
+}
+
+void testNumbers() {
+    // both bounds of a 32 and a 64 bit long, one past them and far beyond
+    const char *values[] = {"2147483647",           "2147483648",           "-2147483648",
+                            "-2147483649",          "4294967296",           "9223372036854775807",
+                            "9223372036854775808",  "-9223372036854775808", "-9223372036854775809",
+                            "99999999999999999999", "-0",                   "+12"};
+    usc::Command cmd;
+    usc::BasicCommand<LeanConfig> lean;
+    printf("Numbers:\n");
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        parseNumber(cmd, "Cached", values[i]);
+        parseNumber(lean, "Lean", values[i]);
+    }
+}
+
+#if USC_STATS
+void printStats(const char *name, const usc::Stats &st) {
+    uint32_t total = 0;
+    printf("%s: frames %u, responses %u, invalid %u, unexpected %u, overflow %u, checksum %u, discarded %u, "
+           "skipped %u\n",
+           name, st.frames, st.responses, st.errors[usc::Invalid], st.errors[usc::Unexpected],
+           st.errors[usc::Overflow], st.checksums, st.discarded, st.skipped);
+    printf("  bytes:");
+    for (int i = 0; i < USC_STATES; i++) {
+        printf(" %u", st.bytes[i]);
+        total += st.bytes[i];
+    }
+    printf(" (%u)\n  lengths:", total);
+    for (int i = 0; i < usc::Stats::Buckets; i++) {
+        printf(" %u", st.lengths[i]);
+    }
+    printf("\n");
+}
+
+void testStats() {
+    std::ifstream file("input.txt");
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    usc::Command single;
+    for (size_t i = 0; i < input.size(); i++) {
+        single.process(input[i]);
+    }
+    printStats("Per char", single.stats());
+
+    usc::Command bulk;
+    usc::Result res;
+    const char *p = input.data();
+    size_t n = input.size();
+    while (n > 0) {
+        size_t used = bulk.process(p, n, res);
+        p += used;
+        n -= used;
+    }
+    printStats("Bulk", bulk.stats());
+
+    usc::Command node(18);
+    node.setAddressFilter();
+    p = input.data();
+    n = input.size();
+    while (n > 0) {
+        size_t used = node.process(p, n, res);
+        p += used;
+        n -= used;
+    }
+    printStats("Skip", node.stats());
+
+    usc::PoolTable<3> pool;
+    for (uint8_t s = 0; s < pool.size(); s++) {
+        pool.process(s, input.data(), input.size());
+    }
+    usc::Stats total;
+    pool.snapshot(total);
+    printStats("Pool", total);
+}
+#endif
+
 int main()
 {
     testCallback();
     printf("\n==========\n");
     testParse();
+    printf("\n==========\n");
+    testBulk();
+    printf("\n==========\n");
+    testView();
+    printf("\n==========\n");
+    testDispatch();
+    printf("\n==========\n");
+    testSchema();
+    printf("\n==========\n");
+    testPool();
+    printf("\n==========\n");
+    testWriter();
+    printf("\n==========\n");
+    testEncoder();
+    printf("\n==========\n");
+    testChecksum();
+    printf("\n==========\n");
+    testFilter();
+    printf("\n==========\n");
+    testId();
+    printf("\n==========\n");
+#if USC_BINARY
+    testBinary();
+    printf("\n==========\n");
+#endif
+    testSegments();
+    printf("\n==========\n");
+    testFrame();
+    printf("\n==========\n");
+    testConfig();
+    printf("\n==========\n");
+    testResync();
+    printf("\n==========\n");
+    testNumbers();
+#if USC_STATS
+    printf("\n==========\n");
+    testStats();
+#endif
     return 0;
 }
\ No newline at end of file
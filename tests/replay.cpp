@@ -0,0 +1,292 @@
+// Records bus traffic into capture files and replays captures through the parser.
+//
+//   replay --record file port...
+//   replay [--realtime] [--speed factor] [--no-latency] [--json] file
+//
+// Recording reads the ports (ttys, ptys or files) with a Gateway until interrupted or
+// until all of them are closed. Replay hands every record to the Command of its port,
+// as fast as possible or at the pace it was recorded (--realtime, scaled by --speed),
+// and reports frames/s, errors per class and the parse latency of each frame, counted
+// from the end of the previous frame or the start of its chunk. At recorded pace it
+// also reports how late the records were handed in.
+#include <signal.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "../src/USCommand.h"
+#include "../host/USCCapture.h"
+#include "../host/USCGateway.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// log2 buckets split in 8, so a bucket is within 12.5% of its values
+struct Histogram {
+    uint64_t counts[64 * 8];
+    uint64_t total;
+    uint64_t max;
+
+    Histogram() : total(0), max(0) {
+        memset(counts, 0, sizeof(counts));
+    }
+    static int index(uint64_t v) {
+        if (v < 8) {
+            return (int)v;
+        }
+        int e = 63 - __builtin_clzll(v);
+        return (e - 2) * 8 + (int)((v >> (e - 3)) & 7);
+    }
+    static uint64_t upper(int i) {
+        if (i < 8) {
+            return i;
+        }
+        int e = i / 8 + 2;
+        return ((uint64_t)(8 + i % 8 + 1) << (e - 3)) - 1;
+    }
+    void add(uint64_t v) {
+        counts[index(v)]++;
+        total++;
+        if (v > max) {
+            max = v;
+        }
+    }
+    uint64_t percentile(double q) const {
+        uint64_t want = (uint64_t)(q * total + 0.5);
+        uint64_t seen = 0;
+        for (int i = 0; i < 64 * 8; i++) {
+            seen += counts[i];
+            if (seen >= want && seen > 0) {
+                return upper(i) < max ? upper(i) : max;
+            }
+        }
+        return max;
+    }
+};
+
+struct Report {
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t responses;
+    uint64_t errors[usc::Overflow + 1];
+    double seconds;
+    double parse;
+    Histogram latency;
+    Histogram lag;
+};
+
+static volatile sig_atomic_t stopped = 0;
+
+static void onSignal(int) {
+    stopped = 1;
+}
+
+static uint64_t nanos(Clock::time_point t0, Clock::time_point t1) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+}
+
+static int record(const char *path, char **ports, int nports) {
+    usc::CaptureWriter cap;
+    if (!cap.open(path)) {
+        perror(path);
+        return 1;
+    }
+    usc::Gateway gw(nports);
+    gw.attachCapture(&cap);
+    for (int i = 0; i < nports; i++) {
+        if (gw.open(ports[i]) < 0) {
+            perror(ports[i]);
+            return 1;
+        }
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // flushed every second, a killed recorder loses little
+    Clock::time_point flushed = Clock::now();
+    for (;;) {
+        bool open = false;
+        for (int i = 0; i < nports; i++) {
+            open = open || gw.isOpen(i);
+        }
+        if (!open || stopped) {
+            break;
+        }
+        gw.poll(200);
+        if (Clock::now() - flushed >= std::chrono::seconds(1)) {
+            cap.flush();
+            flushed = Clock::now();
+        }
+    }
+    uint64_t records = cap.records();
+    uint64_t bytes = cap.bytes();
+    if (!cap.close()) {
+        perror(path);
+        return 1;
+    }
+    fprintf(stderr, "%llu records, %llu bytes\n", (unsigned long long)records, (unsigned long long)bytes);
+    return 0;
+}
+
+static void replay(usc::CaptureReader &rd, bool realtime, double speed, bool latency, Report &r) {
+    usc::Command *cmds[256] = {};
+    usc::CaptureRecord rec;
+    Clock::time_point start = Clock::now();
+    while (rd.next(rec)) {
+        if (realtime) {
+            Clock::time_point due = start + std::chrono::microseconds((uint64_t)(rec.time / speed));
+            std::this_thread::sleep_until(due);
+            Clock::time_point now = Clock::now();
+            r.lag.add(now > due ? nanos(due, now) : 0);
+        }
+        usc::Command *&cmd = cmds[rec.port];
+        if (cmd == nullptr) {
+            cmd = new usc::Command();
+        }
+
+        const char *p = rec.data;
+        size_t n = rec.length;
+        Clock::time_point t0 = Clock::now();
+        Clock::time_point t = t0;
+        while (n > 0) {
+            usc::Result res;
+            size_t used = cmd->process(p, n, res);
+            p += used;
+            n -= used;
+            if (res == usc::Next) {
+                continue;
+            }
+            if (latency) {
+                Clock::time_point now = Clock::now();
+                r.latency.add(nanos(t, now));
+                t = now;
+            }
+            r.errors[res]++;
+            if (res == usc::OK) {
+                r.frames++;
+                r.responses += cmd->isResponse();
+            }
+        }
+        r.parse += nanos(t0, Clock::now()) / 1e9;
+        r.records++;
+        r.bytes += rec.length;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+#if USC_STATS
+    usc::Stats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < 256; i++) {
+        if (cmds[i]) {
+            usc::addStats(total, cmds[i]->stats());
+        }
+    }
+    fprintf(stderr, "checksum mismatches: %lu, discarded bytes: %lu\n", (unsigned long)total.checksums,
+            (unsigned long)total.discarded);
+#endif
+    for (int i = 0; i < 256; i++) {
+        delete cmds[i];
+    }
+}
+
+static void printText(const Report &r, bool realtime) {
+    printf("records    %llu\n", (unsigned long long)r.records);
+    printf("bytes      %llu\n", (unsigned long long)r.bytes);
+    printf("frames     %llu (%llu responses)\n", (unsigned long long)r.frames, (unsigned long long)r.responses);
+    printf("errors     invalid %llu, unexpected %llu, overflow %llu\n", (unsigned long long)r.errors[usc::Invalid],
+           (unsigned long long)r.errors[usc::Unexpected], (unsigned long long)r.errors[usc::Overflow]);
+    printf("wall time  %.3f s\n", r.seconds);
+    printf("parse time %.3f s, %.1f MB/s, %.0f frames/s\n", r.parse, r.bytes / r.parse / 1e6, r.frames / r.parse);
+    if (r.latency.total > 0) {
+        printf("latency ns p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+               (unsigned long long)r.latency.percentile(0.50), (unsigned long long)r.latency.percentile(0.90),
+               (unsigned long long)r.latency.percentile(0.99), (unsigned long long)r.latency.percentile(0.999),
+               (unsigned long long)r.latency.max);
+    }
+    if (realtime) {
+        printf("lag us     p50 %llu, p99 %llu, max %llu\n", (unsigned long long)r.lag.percentile(0.50) / 1000,
+               (unsigned long long)r.lag.percentile(0.99) / 1000, (unsigned long long)r.lag.max / 1000);
+    }
+}
+
+static void printJson(const Report &r, const char *path, bool realtime) {
+    printf("{\n");
+    printf("  \"capture\": \"%s\",\n", path);
+    printf("  \"realtime\": %s,\n", realtime ? "true" : "false");
+    printf("  \"records\": %llu,\n", (unsigned long long)r.records);
+    printf("  \"bytes\": %llu,\n", (unsigned long long)r.bytes);
+    printf("  \"frames\": %llu,\n", (unsigned long long)r.frames);
+    printf("  \"responses\": %llu,\n", (unsigned long long)r.responses);
+    printf("  \"errors\": {\"invalid\": %llu, \"unexpected\": %llu, \"overflow\": %llu},\n",
+           (unsigned long long)r.errors[usc::Invalid], (unsigned long long)r.errors[usc::Unexpected],
+           (unsigned long long)r.errors[usc::Overflow]);
+    printf("  \"real_time\": %.6f,\n", r.seconds);
+    printf("  \"parse_time\": %.6f,\n", r.parse);
+    printf("  \"bytes_per_second\": %.0f,\n", r.bytes / r.parse);
+    printf("  \"frames_per_second\": %.0f,\n", r.frames / r.parse);
+    printf("  \"latency_ns\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu},\n",
+           (unsigned long long)r.latency.percentile(0.50), (unsigned long long)r.latency.percentile(0.90),
+           (unsigned long long)r.latency.percentile(0.99), (unsigned long long)r.latency.percentile(0.999),
+           (unsigned long long)r.latency.max);
+    printf("  \"lag_ns\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu}\n",
+           (unsigned long long)r.lag.percentile(0.50), (unsigned long long)r.lag.percentile(0.99),
+           (unsigned long long)r.lag.max);
+    printf("}\n");
+}
+
+static int usage(const char *name) {
+    fprintf(stderr, "usage: %s --record file port...\n", name);
+    fprintf(stderr, "       %s [--realtime] [--speed factor] [--no-latency] [--json] file\n", name);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    bool realtime = false;
+    bool latency = true;
+    bool json = false;
+    double speed = 1;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 2 < argc) {
+            return record(argv[i + 1], argv + i + 2, argc - i - 2);
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime = true;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+            realtime = true;
+        } else if (strcmp(argv[i], "--no-latency") == 0) {
+            latency = false;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (argv[i][0] != '-' && path == nullptr) {
+            path = argv[i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (path == nullptr || speed <= 0) {
+        return usage(argv[0]);
+    }
+
+    usc::CaptureReader rd;
+    if (!rd.open(path)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        return 1;
+    }
+    Report *r = new Report();
+    memset(r->errors, 0, sizeof(r->errors));
+    r->records = r->bytes = r->frames = r->responses = 0;
+    r->parse = 0;
+    replay(rd, realtime, speed, latency, *r);
+    if (rd.isTruncated()) {
+        fprintf(stderr, "%s: truncated after %llu records\n", path, (unsigned long long)r->records);
+    }
+    if (json) {
+        printJson(*r, path, realtime);
+    } else {
+        printText(*r, realtime);
+    }
+    delete r;
+    return 0;
+}